@@ -0,0 +1,236 @@
+#include "bitboard.hpp"
+
+namespace BB
+{
+    std::array<Magic, static_cast<size_t>(Map::CNT_SQUARES)> RookMagics;
+    std::array<Magic, static_cast<size_t>(Map::CNT_SQUARES)> BishopMagics;
+    std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, 2> PawnAttacks;
+    std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> KnightAttacks;
+    std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> KingAttacks;
+    std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, static_cast<size_t>(Map::CNT_SQUARES)> BetweenBB;
+    std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, static_cast<size_t>(Map::CNT_SQUARES)> LineBB;
+
+    namespace
+    {
+        // Общие таблицы атак по всем полям, размер считается в init_magics
+        std::vector<Bitboard> RookTable;
+        std::vector<Bitboard> BishopTable;
+
+        constexpr int ROOK_DIRECTIONS[] = {NORTH, EAST, SOUTH, WEST};
+        constexpr int BISHOP_DIRECTIONS[] = {NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST};
+        constexpr int KNIGHT_DIRECTIONS[] = {NORTH + NORTH_EAST, NORTH + NORTH_WEST, EAST + NORTH_EAST, EAST + SOUTH_EAST,
+                                             SOUTH + SOUTH_EAST, SOUTH + SOUTH_WEST, WEST + SOUTH_WEST, WEST + NORTH_WEST};
+        constexpr int KING_DIRECTIONS[] = {NORTH, EAST, SOUTH, WEST, NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST};
+
+        constexpr Bitboard rank_bb(uint16_t sq) { return RANK_1 << (8 * (sq >> 3)); }
+        constexpr Bitboard file_bb(uint16_t sq) { return FILE_A << (sq & 0x7); }
+
+        // Шаг на соседнее поле без перескока через край доски (для коня допускается расстояние 3)
+        constexpr bool is_valid_step(int from_sq, int to_sq, int max_dist)
+        {
+            if (to_sq < 0 || to_sq >= static_cast<int>(Map::CNT_SQUARES)) return false;
+            int delta_x = (from_sq & 0x7) - (to_sq & 0x7);
+            int delta_y = (from_sq >> 3) - (to_sq >> 3);
+            return (delta_x < 0 ? -delta_x : delta_x) + (delta_y < 0 ? -delta_y : delta_y) <= max_dist;
+        }
+
+        // Медленная генерация атак обходом лучей - только для построения таблиц
+        Bitboard sliding_attack(const int *directions, uint16_t sq, Bitboard occupied)
+        {
+            Bitboard attacks = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int s = sq; is_valid_step(s, s + directions[i], 2); s += directions[i])
+                {
+                    attacks |= square_bb(s + directions[i]);
+                    if (occupied & square_bb(s + directions[i])) break;
+                }
+            }
+            return attacks;
+        }
+
+        Bitboard leaping_attack(const int *directions, int num_directions, uint16_t sq, int max_dist)
+        {
+            Bitboard attacks = 0;
+            for (int i = 0; i < num_directions; ++i)
+            {
+                if (is_valid_step(sq, sq + directions[i], max_dist)) attacks |= square_bb(sq + directions[i]);
+            }
+            return attacks;
+        }
+
+#ifndef USE_PEXT
+        // Множители, найденные поиском ниже (init_magics с теми же зёрнами) и сохранённые, чтобы не искать
+        // их при каждом запуске: на 12-битных полях ладьи поиск перебирает сотни тысяч кандидатов.
+        // При запуске каждый проверяется, негодный (после правки масок) заменяется новым поиском
+        constexpr std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> ROOK_MAGICS = {
+            0x0080002080400010ULL, 0x1040100040002004ULL, 0x0200084200102080ULL, 0x2480051000800800ULL,
+            0x5600080200200490ULL, 0x2200108200084104ULL, 0x04001020A1240802ULL, 0x010001CA01906100ULL,
+            0x00A0800020400090ULL, 0x0220404000201000ULL, 0x0000802000100080ULL, 0xA002001022000840ULL,
+            0x0093001100080004ULL, 0x0400800200040080ULL, 0x0005000402000100ULL, 0x8040802880084100ULL,
+            0x6000618001400080ULL, 0x111000C000402001ULL, 0x0100848020001000ULL, 0x4C00808010000800ULL,
+            0x0000808004000800ULL, 0x4004808004000200ULL, 0x1000140022104108ULL, 0x5081020010842441ULL,
+            0x000080A180004001ULL, 0x2020100040002040ULL, 0x0200110100200041ULL, 0x0200080080100080ULL,
+            0x0001110500080100ULL, 0x0002000200080410ULL, 0x0000040101000200ULL, 0x0022040200109041ULL,
+            0x2400804002800028ULL, 0x0180401001402003ULL, 0x0000200101004012ULL, 0x8000081202004020ULL,
+            0x1000800400800802ULL, 0x4044000480800200ULL, 0x0021800100800200ULL, 0x1C2005148200004CULL,
+            0x0280204000808006ULL, 0x1010002000404000ULL, 0x1210002000808010ULL, 0x005C100100210008ULL,
+            0x0009008802050010ULL, 0x2000020004008080ULL, 0x8000010002008080ULL, 0x1000A06100820004ULL,
+            0x00A0604000800280ULL, 0x0000810040002100ULL, 0x8020090020104100ULL, 0x2000801000080080ULL,
+            0x0814000800800480ULL, 0x0404004002010040ULL, 0x0041211002081400ULL, 0x4005000200408100ULL,
+            0x0C81020040142082ULL, 0x0405184001006081ULL, 0x4042081100442001ULL, 0x0041002008061001ULL,
+            0x8420250011080015ULL, 0x4806000110880422ULL, 0x04201008020100C4ULL, 0x0112002100408402ULL,
+        };
+        constexpr std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> BISHOP_MAGICS = {
+            0x00200400C2024204ULL, 0x000828012C002202ULL, 0x0E18848400800239ULL, 0x020804A100410082ULL,
+            0x5004042182008000ULL, 0x0201010840049050ULL, 0x0201091050044008ULL, 0x0000104208244004ULL,
+            0x0000920421041400ULL, 0x0148040400841100ULL, 0x0002144414005000ULL, 0x00003804AB000080ULL,
+            0x0009091140000000ULL, 0x0000A10160110002ULL, 0x0204A10808440600ULL, 0x0041082208420800ULL,
+            0x0040000409080100ULL, 0x0808202012848203ULL, 0x001802140A401204ULL, 0x1A3800542208E012ULL,
+            0x0008800404A04000ULL, 0x2002800148200800ULL, 0x0801018608018480ULL, 0x860300C084480241ULL,
+            0x0004100020200110ULL, 0x0001A02010040D1CULL, 0x2120440088440C00ULL, 0x4D20120000400440ULL,
+            0x3025001007004000ULL, 0x0808002062020140ULL, 0x80010A0402481400ULL, 0x8000A20104210418ULL,
+            0x082210C080508200ULL, 0x04A8242210101208ULL, 0x0814020102020408ULL, 0x0002020084080080ULL,
+            0xF4D04404400C0100ULL, 0xCD10010200971040ULL, 0x1001010400010410ULL, 0x200A08910032005CULL,
+            0x00808808C1006902ULL, 0x00B4882110040800ULL, 0x0101802808006100ULL, 0x0000044200880800ULL,
+            0x080C182011000813ULL, 0x0120210121080200ULL, 0x1150447800800040ULL, 0x0002080200942028ULL,
+            0x0008880111100A00ULL, 0x2084C3480C501606ULL, 0x1000504208044500ULL, 0x0000000242021001ULL,
+            0x00200C40192A0210ULL, 0x0800220401420200ULL, 0x0307500208010000ULL, 0x0802081845044800ULL,
+            0x0402020041041000ULL, 0x00000A0206421220ULL, 0x8020002100411080ULL, 0x009184102C208800ULL,
+            0x2240000088130C00ULL, 0x0008012060220080ULL, 0x0580408481020200ULL, 0x5110821024102140ULL,
+        };
+
+        // Проба множителя для поля: все подмножества маски должны лечь в ячейки без конфликтов
+        // (совпадение индексов допустимо, только если совпадают и атаки). Пустая ячейка - 0: атаки
+        // дальнобойной фигуры никогда не пусты. При неудаче обнуляются только записанные ячейки
+        bool try_magic(Magic &m, Bitboard magic, const std::vector<Bitboard> &occupancy, const std::vector<Bitboard> &reference)
+        {
+            // Индекс берётся из старших битов произведения: если в них мало единиц, он почти не зависит от занятости
+            if (popcount((m.mask * magic) & 0xFF00000000000000ULL) < 6)
+            {
+                return false;
+            }
+            m.magic = magic;
+            size_t filled = 0;
+            for (; filled < occupancy.size(); ++filled)
+            {
+                Bitboard &slot = m.attacks[m.index(occupancy[filled])];
+                if (slot == 0)
+                {
+                    slot = reference[filled];
+                }
+                else if (slot != reference[filled])
+                {
+                    break;
+                }
+            }
+            if (filled == occupancy.size())
+            {
+                return true;
+            }
+            for (size_t i = 0; i < filled; ++i)
+            {
+                m.attacks[m.index(occupancy[i])] = 0;
+            }
+            return false;
+        }
+#endif
+
+        void init_magics(const int *directions, std::vector<Bitboard> &table, std::array<Magic, static_cast<size_t>(Map::CNT_SQUARES)> &magics,
+                         [[maybe_unused]] const std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> &known, [[maybe_unused]] uint64_t seed)
+        {
+            // Маски и общий размер: полю достаётся 2^popcount(mask) ячеек, по одной на подмножество маски
+            size_t total = 0;
+            for (uint16_t sq = 0; sq < static_cast<uint16_t>(Map::CNT_SQUARES); ++sq)
+            {
+                // Крайние поля не влияют на атаки, если фигура не стоит на этой же линии
+                const Bitboard edges = ((RANK_1 | RANK_8) & ~rank_bb(sq)) | ((FILE_A | FILE_H) & ~file_bb(sq));
+                Magic &m = magics[sq];
+                m.mask = sliding_attack(directions, sq, 0) & ~edges;
+                m.shift = 64 - popcount(m.mask);
+                total += size_t{1} << popcount(m.mask);
+            }
+            table.assign(total, 0);
+
+            std::vector<Bitboard> occupancy, reference;
+            occupancy.reserve(4096);
+            reference.reserve(4096);
+#ifndef USE_PEXT
+            PRNG rng{seed};
+#endif
+            Bitboard *next = table.data();
+            for (uint16_t sq = 0; sq < static_cast<uint16_t>(Map::CNT_SQUARES); ++sq)
+            {
+                Magic &m = magics[sq];
+                m.attacks = next;
+                next += size_t{1} << popcount(m.mask);
+
+                // Все подмножества маски: (b - mask) & mask даёт следующее по возрастанию
+                occupancy.clear();
+                reference.clear();
+                Bitboard b = 0;
+                do
+                {
+                    occupancy.push_back(b);
+                    reference.push_back(sliding_attack(directions, sq, b));
+                    b = (b - m.mask) & m.mask;
+                } while (b);
+
+#ifdef USE_PEXT
+                for (size_t i = 0; i < occupancy.size(); ++i)
+                {
+                    m.attacks[m.index(occupancy[i])] = reference[i];
+                }
+#else
+                if (try_magic(m, known[sq], occupancy, reference))
+                {
+                    continue;
+                }
+                while (!try_magic(m, rng.sparse_rand(), occupancy, reference))
+                {
+                }
+#endif
+            }
+        }
+    } // namespace
+
+    void init()
+    {
+        for (uint16_t sq = 0; sq < static_cast<uint16_t>(Map::CNT_SQUARES); ++sq)
+        {
+            const int white_pawn[] = {NORTH_WEST, NORTH_EAST};
+            const int black_pawn[] = {SOUTH_WEST, SOUTH_EAST};
+            PawnAttacks[static_cast<size_t>(Color::WHITE)][sq] = leaping_attack(white_pawn, 2, sq, 2);
+            PawnAttacks[static_cast<size_t>(Color::BLACK)][sq] = leaping_attack(black_pawn, 2, sq, 2);
+            KnightAttacks[sq] = leaping_attack(KNIGHT_DIRECTIONS, 8, sq, 3);
+            KingAttacks[sq] = leaping_attack(KING_DIRECTIONS, 8, sq, 2);
+        }
+
+#ifdef USE_PEXT
+        // С PEXT множители не нужны
+        constexpr std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> ROOK_MAGICS{}, BISHOP_MAGICS{};
+#endif
+        init_magics(ROOK_DIRECTIONS, RookTable, RookMagics, ROOK_MAGICS, 0x0F1E2D3C4B5A6978ULL);
+        init_magics(BISHOP_DIRECTIONS, BishopTable, BishopMagics, BISHOP_MAGICS, 0x1234567887654321ULL);
+
+        for (uint16_t a = 0; a < static_cast<uint16_t>(Map::CNT_SQUARES); ++a)
+        {
+            for (uint16_t b = 0; b < static_cast<uint16_t>(Map::CNT_SQUARES); ++b)
+            {
+                BetweenBB[a][b] = LineBB[a][b] = 0;
+                if (a == b) continue;
+
+                if (rook_attacks(a, 0) & square_bb(b))
+                {
+                    LineBB[a][b] = (rook_attacks(a, 0) & rook_attacks(b, 0)) | square_bb(a) | square_bb(b);
+                    BetweenBB[a][b] = rook_attacks(a, square_bb(b)) & rook_attacks(b, square_bb(a));
+                }
+                else if (bishop_attacks(a, 0) & square_bb(b))
+                {
+                    LineBB[a][b] = (bishop_attacks(a, 0) & bishop_attacks(b, 0)) | square_bb(a) | square_bb(b);
+                    BetweenBB[a][b] = bishop_attacks(a, square_bb(b)) & bishop_attacks(b, square_bb(a));
+                }
+            }
+        }
+    }
+} // namespace BB
@@ -0,0 +1,156 @@
+#pragma once
+#include "types.h"
+#include <bits/stdc++.h>
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
+namespace BB
+{
+    constexpr Bitboard EMPTY = 0;
+    constexpr Bitboard FILE_A = 0x0101010101010101ULL;
+    constexpr Bitboard FILE_H = FILE_A << 7;
+    constexpr Bitboard RANK_1 = 0xFFULL;
+    constexpr Bitboard RANK_2 = RANK_1 << 8;
+    constexpr Bitboard RANK_7 = RANK_1 << 48;
+    constexpr Bitboard RANK_8 = RANK_1 << 56;
+    constexpr Bitboard ALL = ~EMPTY;
+
+    constexpr inline Bitboard square_bb(uint16_t sq)
+    {
+        return Bitboard{1} << sq;
+    }
+
+    constexpr inline int popcount(Bitboard b)
+    {
+        return std::popcount(b);
+    }
+
+    // Индекс младшего установленного бита, b != 0
+    constexpr inline uint16_t lsb(Bitboard b)
+    {
+        return static_cast<uint16_t>(std::countr_zero(b));
+    }
+
+    // Возвращает младший бит и снимает его с доски, b != 0
+    constexpr inline uint16_t pop_lsb(Bitboard &b)
+    {
+        const uint16_t sq = lsb(b);
+        b &= b - 1;
+        return sq;
+    }
+
+    constexpr inline bool more_than_one(Bitboard b)
+    {
+        return b & (b - 1);
+    }
+
+    // splitmix64, детерминированный - таблицы и ключи одинаковы от запуска к запуску
+    struct PRNG
+    {
+        uint64_t s;
+        uint64_t rand()
+        {
+            uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+        // Около 8 единичных битов из 64: разреженные множители чаще оказываются магическими
+        uint64_t sparse_rand() { return rand() & rand() & rand(); }
+    };
+
+    // Магическая запись для дальнобойной фигуры на одном поле: атаки = attacks[index(occupied)]
+    struct Magic
+    {
+        Bitboard mask;   // значимые поля лучей без краёв доски
+        Bitboard magic;  // не используется при USE_PEXT
+        Bitboard *attacks;
+        unsigned shift;
+
+        inline unsigned index(Bitboard occupied) const
+        {
+#ifdef USE_PEXT
+            return static_cast<unsigned>(_pext_u64(occupied, mask));
+#else
+            return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+#endif
+        }
+    };
+
+    extern std::array<Magic, static_cast<size_t>(Map::CNT_SQUARES)> RookMagics;
+    extern std::array<Magic, static_cast<size_t>(Map::CNT_SQUARES)> BishopMagics;
+    extern std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, 2> PawnAttacks;
+    extern std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> KnightAttacks;
+    extern std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> KingAttacks;
+    extern std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, static_cast<size_t>(Map::CNT_SQUARES)> BetweenBB;
+    extern std::array<std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)>, static_cast<size_t>(Map::CNT_SQUARES)> LineBB;
+
+    // Заполняет таблицы атак, вызывается один раз при старте до любой генерации ходов
+    void init();
+
+    inline Bitboard rook_attacks(uint16_t sq, Bitboard occupied)
+    {
+        const Magic &m = RookMagics[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline Bitboard bishop_attacks(uint16_t sq, Bitboard occupied)
+    {
+        const Magic &m = BishopMagics[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline Bitboard queen_attacks(uint16_t sq, Bitboard occupied)
+    {
+        return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+    }
+
+    inline Bitboard pawn_attacks(Color c, uint16_t sq)
+    {
+        return PawnAttacks[static_cast<size_t>(c)][sq];
+    }
+
+    // Поля строго между a и b, если они на одной линии, иначе пусто
+    inline Bitboard between(uint16_t a, uint16_t b)
+    {
+        return BetweenBB[a][b];
+    }
+
+    // Вся линия (от края до края) через a и b, если они на одной линии, иначе пусто
+    inline Bitboard line(uint16_t a, uint16_t b)
+    {
+        return LineBB[a][b];
+    }
+
+    // Атаки любой фигуры кроме пешки
+    inline Bitboard attacks(PieceType pt, uint16_t sq, Bitboard occupied)
+    {
+        switch (pt)
+        {
+        case PieceType::KNIGHT: return KnightAttacks[sq];
+        case PieceType::BISHOP: return bishop_attacks(sq, occupied);
+        case PieceType::ROOK:   return rook_attacks(sq, occupied);
+        case PieceType::QUEEN:  return queen_attacks(sq, occupied);
+        case PieceType::KING:   return KingAttacks[sq];
+        default:                return EMPTY;
+        }
+    }
+
+    // Отладочный вывод битборда в виде доски 8x8
+    inline std::string pretty(Bitboard b)
+    {
+        std::string s = "  +-----------------+\n";
+        for (int rank = static_cast<int>(Map::HEIGHT) - 1; rank >= 0; --rank)
+        {
+            s += std::to_string(rank + 1) + " | ";
+            for (int file = 0; file < static_cast<int>(Map::WIDTH); ++file)
+            {
+                s += (b & square_bb(rank * static_cast<int>(Map::WIDTH) + file)) ? "X " : ". ";
+            }
+            s += "|\n";
+        }
+        s += "  +-----------------+\n    a b c d e f g h\n";
+        return s;
+    }
+} // namespace BB
@@ -0,0 +1,24 @@
+#include "evaluate.hpp"
+
+namespace Eval
+{
+    int evaluate(const Position &pos, Pawns::Table &pawns)
+    {
+        if (!pos.accumulators.empty())
+        {
+            return NNUE::evaluate(pos);
+        }
+
+        // Фаза по оставшимся лёгким и тяжёлым фигурам: MAX_PHASE - миттельшпиль, 0 - чистый эндшпиль.
+        // После превращений сумма может превысить MAX_PHASE
+        int phase = PSQT::PHASE_WEIGHT[static_cast<size_t>(PieceType::KNIGHT)] * BB::popcount(pos.pieces(PieceType::KNIGHT)) +
+                    PSQT::PHASE_WEIGHT[static_cast<size_t>(PieceType::BISHOP)] * BB::popcount(pos.pieces(PieceType::BISHOP)) +
+                    PSQT::PHASE_WEIGHT[static_cast<size_t>(PieceType::ROOK)] * BB::popcount(pos.pieces(PieceType::ROOK)) +
+                    PSQT::PHASE_WEIGHT[static_cast<size_t>(PieceType::QUEEN)] * BB::popcount(pos.pieces(PieceType::QUEEN));
+        phase = std::min(phase, PSQT::MAX_PHASE);
+
+        const PSQT::Score total = pos.psq + Pawns::evaluate(pos, pawns);
+        const int score = (PSQT::mg_value(total) * phase + PSQT::eg_value(total) * (PSQT::MAX_PHASE - phase)) / PSQT::MAX_PHASE;
+        return Position::get_side_to_move(pos) ? -score : score;
+    }
+} // namespace Eval
@@ -0,0 +1,15 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include "pawns.hpp"
+#include <bits/stdc++.h>
+
+namespace Eval
+{
+    // Стоимость фигур в сантипешках, индекс - PieceType; используется в SEE и упорядочивании ходов
+    constexpr std::array<int, static_cast<size_t>(PieceType::QUEEN) + 1> PIECE_VALUE = {0, 0, 100, 320, 330, 500, 900};
+
+    // Статическая оценка с точки зрения стороны, чья очередь хода: сеть, если загружена,
+    // иначе смесь mg/eg из pos.psq и структуры пешек (из кэша потока) по фазе партии. В обоих случаях без обхода фигур
+    int evaluate(const Position &pos, Pawns::Table &pawns);
+} // namespace Eval
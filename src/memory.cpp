@@ -0,0 +1,39 @@
+#include "memory.hpp"
+
+#ifdef DEBUG
+namespace Memory
+{
+    thread_local uint64_t t_allocations = 0;
+} // namespace Memory
+
+// Замены держим в отдельной единице трансляции: иначе они встраиваются в вызывающий код
+// и GCC видит malloc в паре с delete (-Wmismatched-new-delete)
+void *operator new(std::size_t size)
+{
+    ++Memory::t_allocations;
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Выровненные типы (NNUE::Accumulator, бакеты кэшей) идут сюда, мимо обычного operator new
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++Memory::t_allocations;
+    const size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc требует размер, кратный выравниванию
+    const size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+    if (void *ptr = std::aligned_alloc(align, rounded))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+#endif
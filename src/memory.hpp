@@ -0,0 +1,11 @@
+#pragma once
+#include <bits/stdc++.h>
+
+#ifdef DEBUG
+namespace Memory
+{
+    // Счётчик обращений к куче из текущего потока: operator new (и выровненный тоже) заменены в memory.cpp.
+    // perft обязан обходиться без них; счётчик свой у потока, чтобы не ловить выделения потоков ввода и поиска
+    extern thread_local uint64_t t_allocations;
+} // namespace Memory
+#endif
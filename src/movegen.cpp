@@ -2,10 +2,6 @@
 
 namespace MoveGen
 {
-    // Смещения для коня
-    constexpr int KNIGHT_DIRECTIONS[] = {NORTH + NORTH_EAST, NORTH + NORTH_WEST, EAST + NORTH_EAST, EAST + SOUTH_EAST, SOUTH + SOUTH_EAST, SOUTH + SOUTH_WEST, WEST + SOUTH_WEST, WEST + NORTH_WEST}; 
-    // 17, 15, 10, -6, -15, -17, -10, 6
-
     constexpr size_t CASTLE_N = 2, COLOR_N = 2;
 
     constexpr uint16_t CASTLING_RIGHTS_MASKS[COLOR_N][CASTLE_N] = {
@@ -21,48 +17,31 @@ namespace MoveGen
         {FEN::square_to_index("h8"), FEN::square_to_index("a8")}
     };
     
-    // Направления для короля
-    constexpr int KING_DIRECTIONS[] = {NORTH, EAST, SOUTH, WEST, NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST};
-    // Направления для ладьи
-    constexpr int const *ROOK_DIRECTIONS = KING_DIRECTIONS;
-    // Направления для слона
-    constexpr int const *BISHOP_DIRECTIONS = KING_DIRECTIONS+sizeof(KING_DIRECTIONS)/sizeof(KING_DIRECTIONS[0])/2;
-
-    
-
     void generate_attacks(const Position &pos, Color side_to_move, AttacksArray &attacks_list)
     {
         attacks_list.size.fill(0);
 
-        for (uint16_t i = 0; i < pos.end_pieces_list; ++i)
+        Bitboard our_pieces = pos.pieces(side_to_move);
+        while (our_pieces)
         {
-            const Piece& p = pos.pieces_list[i];
-            Color piece_color = FEN::get_piece_color(p.type);
-
-            if (piece_color != side_to_move) continue;
-
-            PieceType piece_type = FEN::get_piece_type(p.type);
-            uint16_t from_sq = p.position;
+            uint16_t from_sq = BB::pop_lsb(our_pieces);
+            PieceType piece_type = FEN::get_piece_type(pos.piece_on(from_sq));
 
             switch (piece_type)
             {
             case PieceType::PAWN:
-                generate_pawn_attacks(pos, side_to_move, from_sq, attacks_list);
+                generate_pawn_attacks(pos, from_sq, attacks_list);
                 break;
             case PieceType::KNIGHT:
-                generate_leaping_attacks(pos, side_to_move, from_sq, KNIGHT_DIRECTIONS, 8, attacks_list);
+            case PieceType::KING:
+                // Если поле пустое или занято фигурой противника
+                add_attacks(from_sq, pos.attacks_from[from_sq] & ~pos.pieces(side_to_move), attacks_list);
                 break;
             case PieceType::BISHOP:
-                generate_sliding_attacks(pos, side_to_move, from_sq, BISHOP_DIRECTIONS, 4, attacks_list);
-                break;
             case PieceType::ROOK:
-                generate_sliding_attacks(pos, side_to_move, from_sq, ROOK_DIRECTIONS, 4, attacks_list);
-                break;
             case PieceType::QUEEN:
-                generate_sliding_attacks(pos, side_to_move, from_sq, KING_DIRECTIONS, 8, attacks_list);
-                break;
-            case PieceType::KING:
-                generate_leaping_attacks(pos, side_to_move, from_sq, KING_DIRECTIONS, 8, attacks_list);
+                // Луч включает первую встреченную фигуру любого цвета
+                add_attacks(from_sq, pos.attacks_from[from_sq], attacks_list);
                 break;
             case PieceType::EMPTY:
             default:
@@ -71,242 +50,339 @@ namespace MoveGen
         }
     }
 
-    void generate_moves(Position &pos, AttacksArray &attacks_list, std::vector<MoveInfo> &move_list)
+    CheckInfo compute_check_info(const Position &pos, Color side_to_move)
     {
-        // move_list.clear();
-        // move_list.reserve(218);
+        CheckInfo ci;
+        const Color them = static_cast<Color>(static_cast<uint16_t>(side_to_move) ^ 1);
+        const uint16_t king_sq = pos.king_sq[static_cast<size_t>(side_to_move)];
 
-        Color side_to_move = static_cast<Color>(Position::get_side_to_move(pos));
-        uint16_t color_bit = static_cast<uint16_t>(side_to_move) << static_cast<uint16_t>(Color::LOG_BIT_COLOR);
-
-        for(size_t i = 0; i< attacks_list.size.size(); ++i){
-            // TODO : Remove checking promotion for 2-7 ranks
-            size_t size = attacks_list.size[i];
-            for(size_t j = 0; j < size; ++j){
-                Move m = attacks_list.sq[i*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ)+j];
-                
-                uint16_t source_sq = m.source();
-                uint16_t moved_idx = pos.board[m.source()];
-                PieceType moved_piece = FEN::get_piece_type(pos.pieces_list[moved_idx].type);
-
-                uint16_t dest_sq = m.dest();
-                uint16_t captured_idx = pos.board[m.dest()];
-                Piece caputred_piece = pos.pieces_list[captured_idx];
-                uint16_t captured_color_bit = caputred_piece.type & static_cast<uint16_t>(Color::BIT_COLOR);
-                
-                if(color_bit == captured_color_bit and captured_idx != static_cast<uint16_t>(Map::CNT_SQUARES)){
-                    continue;
-                }
-                if(moved_piece == PieceType::PAWN and (dest_sq != pos.enpassant_target_square and captured_idx == static_cast<uint16_t>(Map::CNT_SQUARES)))
-                {
-                    continue;
-                }
+        ci.checkers = pos.attackers_to(king_sq, pos.occupied) & pos.pieces(them);
 
-                auto next_attacks = std::make_shared<AttacksArray>();
-                if(is_legal(m, pos, attacks_list, *next_attacks)){
-                    if(moved_piece == PieceType::PAWN){
-                        generate_pawn_promotions(m, side_to_move, move_list, next_attacks);
-                        continue;
-                    }
-                    move_list.emplace_back(m,next_attacks);
-                }
+        // Связки: дальнобойная фигура противника видит короля сквозь ровно одну нашу фигуру
+        ci.pinned = 0;
+        Bitboard snipers = (BB::rook_attacks(king_sq, 0) & (pos.pieces(them, PieceType::ROOK) | pos.pieces(them, PieceType::QUEEN))) |
+                           (BB::bishop_attacks(king_sq, 0) & (pos.pieces(them, PieceType::BISHOP) | pos.pieces(them, PieceType::QUEEN)));
+        while (snipers)
+        {
+            Bitboard blockers = BB::between(king_sq, BB::pop_lsb(snipers)) & pos.occupied;
+            if (blockers and !BB::more_than_one(blockers) and (blockers & pos.pieces(side_to_move)))
+            {
+                ci.pinned |= blockers;
             }
         }
 
-        for (uint16_t i = 0; i < pos.end_pieces_list; ++i)
+        if (!ci.checkers)
+            ci.check_mask = BB::ALL;
+        else if (!BB::more_than_one(ci.checkers))
+            ci.check_mask = BB::between(king_sq, BB::lsb(ci.checkers)) | ci.checkers;
+        else
+            ci.check_mask = 0; // двойной шах - ходит только король
+
+        // Лучи шахующих дальнобойных фигур продолжаются за королём: отступать вдоль них нельзя
+        ci.king_danger = pos.attacked_by(them);
+        Bitboard slider_checkers = ci.checkers & ~pos.pieces(PieceType::PAWN) & ~pos.pieces(PieceType::KNIGHT);
+        while (slider_checkers)
         {
-            const Piece& p = pos.pieces_list[i];
-            Color piece_color = FEN::get_piece_color(p.type);
+            uint16_t checker_sq = BB::pop_lsb(slider_checkers);
+            ci.king_danger |= BB::line(king_sq, checker_sq) & ~BB::square_bb(checker_sq);
+        }
+        return ci;
+    }
 
-            if (piece_color != side_to_move) continue;
+    // Допустимые поля назначения по типу генерации (без учёта пешек)
+    template <GenType T>
+    constexpr Bitboard gen_targets(const Position &pos, Color side_to_move)
+    {
+        const Color them = static_cast<Color>(static_cast<uint16_t>(side_to_move) ^ 1);
+        if constexpr (T == GenType::CAPTURES)
+            return pos.pieces(them);
+        else if constexpr (T == GenType::QUIETS)
+            return ~pos.occupied;
+        else
+            return ~pos.pieces(side_to_move);
+    }
 
-            PieceType piece_type = FEN::get_piece_type(p.type);
-            uint16_t from_sq = p.position;
+    void generate_moves(const Position &pos, MoveList &move_list)
+    {
+        const CheckInfo ci = compute_check_info(pos, static_cast<Color>(Position::get_side_to_move(pos)));
+        generate<GenType::LEGAL>(pos, ci, move_list);
+    }
 
-            switch (piece_type)
+    template <GenType T>
+    void generate(const Position &pos, const CheckInfo &ci, MoveList &move_list)
+    {
+        Color side_to_move = static_cast<Color>(Position::get_side_to_move(pos));
+
+        generate_king_moves<T>(pos, side_to_move, ci, move_list);
+        if (BB::more_than_one(ci.checkers))
+        {
+            return;
+        }
+        generate_pawn_moves<T>(pos, side_to_move, ci, move_list);
+        generate_piece_moves<T>(pos, side_to_move, ci, move_list);
+    }
+
+    template void generate<GenType::CAPTURES>(const Position &, const CheckInfo &, MoveList &);
+    template void generate<GenType::QUIETS>(const Position &, const CheckInfo &, MoveList &);
+    template void generate<GenType::LEGAL>(const Position &, const CheckInfo &, MoveList &);
+
+    template <GenType T>
+    void generate_piece_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list)
+    {
+        const uint16_t king_sq = pos.king_sq[static_cast<size_t>(side_to_move)];
+        const Bitboard target_mask = gen_targets<T>(pos, side_to_move) & ci.check_mask;
+
+        Bitboard pieces = pos.pieces(side_to_move) & ~pos.pieces(PieceType::PAWN) & ~pos.pieces(PieceType::KING);
+        while (pieces)
+        {
+            uint16_t from_sq = BB::pop_lsb(pieces);
+            Bitboard targets = pos.attacks_from[from_sq] & target_mask;
+            if (ci.pinned & BB::square_bb(from_sq))
             {
-            case PieceType::PAWN:
-                {
-                    PawnQuiteMoves pawn_list;
-                    pawn_list.fill(Move::none());
-                    generate_pawn_moves(pos,side_to_move, from_sq, pawn_list);
-                    
-                    size_t size = 0;
-                    while(pawn_list[size] != Move::none()){
-                        auto next_attacks = std::make_shared<AttacksArray>();
-                        if(is_legal(pawn_list[size], pos, attacks_list, *next_attacks)){
-                            generate_pawn_promotions(pawn_list[size], side_to_move, move_list, next_attacks);
-                        }
-                        ++size;
-                    }
-                }
-                break;
-            case PieceType::KING:
-                generate_castling_moves(pos, side_to_move, attacks_list, move_list);            
-                break;
-            case PieceType::EMPTY:
-            default:
-                break;
+                targets &= BB::line(king_sq, from_sq); // связанная фигура ходит только вдоль связки
+            }
+            while (targets)
+            {
+                move_list.push_back(Move(from_sq, BB::pop_lsb(targets)));
             }
         }
     }
 
-    void generate_pawn_moves(const Position &pos, Color side_to_move, uint16_t from_sq, PawnQuiteMoves &move_list) {
-        size_t size = 0;
+    template <GenType T>
+    void generate_king_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list)
+    {
+        const uint16_t king_sq = pos.king_sq[static_cast<size_t>(side_to_move)];
 
-        int push_once = side_to_move == Color::WHITE ? NORTH : SOUTH;
-        
-        int push_once_dest = from_sq + push_once; // always is valid if pawn is not on the first or last rank
-        int push_twice_dest = push_once_dest + push_once; // always is valid if is_promotion == false
+        Bitboard targets = BB::KingAttacks[king_sq] & gen_targets<T>(pos, side_to_move) & ~ci.king_danger;
+        while (targets)
+        {
+            move_list.push_back(Move(king_sq, BB::pop_lsb(targets)));
+        }
 
-        int push_twice_inv_dest = from_sq - 2*push_once;
-        bool is_start_rank =  push_twice_inv_dest < 0 or push_twice_inv_dest >= static_cast<int>(Map::CNT_SQUARES);
+        if (T != GenType::CAPTURES and !ci.checkers)
+        {
+            generate_castling_moves(pos, side_to_move, ci, move_list);
+        }
+    }
 
-        // No capture
-        if(pos.board[push_once_dest] == static_cast<uint16_t>(Map::CNT_SQUARES)){
-            move_list[size++] = Move(from_sq, push_once_dest);
-            if (is_start_rank and pos.board[push_twice_dest] == static_cast<uint16_t>(Map::CNT_SQUARES)){
-                move_list[size++] = Move(from_sq, push_twice_dest);
+    template <GenType T>
+    void generate_pawn_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list) {
+        const Color them = static_cast<Color>(static_cast<uint16_t>(side_to_move) ^ 1);
+        const uint16_t king_sq = pos.king_sq[static_cast<size_t>(side_to_move)];
+        const int push_once = side_to_move == Color::WHITE ? NORTH : SOUTH;
+        const Bitboard start_rank = side_to_move == Color::WHITE ? BB::RANK_2 : BB::RANK_7;
+        const Bitboard last_rank = side_to_move == Color::WHITE ? BB::RANK_8 : BB::RANK_1;
+
+        // Превращения без взятия считаются "взятиями": они так же резко меняют материал
+        Bitboard allowed_targets = BB::ALL;
+        if constexpr (T == GenType::CAPTURES)
+            allowed_targets = pos.pieces(them) | last_rank;
+        else if constexpr (T == GenType::QUIETS)
+            allowed_targets = ~pos.pieces(them) & ~last_rank;
+
+        // Форсированный поиск зовёт только взятия: пешки, которым нечего бить и которые не превращаются, отсеиваем сразу
+        const Bitboard capture_targets = pos.pieces(them) |
+            (pos.enpassant_target_square != static_cast<uint16_t>(Map::CNT_SQUARES) ? BB::square_bb(pos.enpassant_target_square) : BB::EMPTY);
+        const Bitboard promotion_from = side_to_move == Color::WHITE ? BB::RANK_7 : BB::RANK_2;
+
+        Bitboard pawns = pos.pieces(side_to_move, PieceType::PAWN);
+        while (pawns)
+        {
+            const uint16_t from_sq = BB::pop_lsb(pawns);
+            if constexpr (T == GenType::CAPTURES)
+            {
+                if (!(BB::pawn_attacks(side_to_move, from_sq) & capture_targets) and !(promotion_from & BB::square_bb(from_sq)))
+                {
+                    continue;
+                }
             }
-        }    
-    }
-    
-    void generate_pawn_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, AttacksArray &attacks_list)
-    {
+            const Bitboard allowed = (ci.pinned & BB::square_bb(from_sq)) ? ci.check_mask & BB::line(king_sq, from_sq) : ci.check_mask;
 
-        // Captures
-        int capture_dirs[] = {(side_to_move == Color::WHITE) ? NORTH_WEST : SOUTH_WEST, (side_to_move == Color::WHITE) ? NORTH_EAST : SOUTH_EAST}; 
+            // No capture
+            Bitboard targets = 0;
+            const uint16_t push_once_dest = from_sq + push_once;
+            if (!(pos.occupied & BB::square_bb(push_once_dest)))
+            {
+                targets |= BB::square_bb(push_once_dest);
+                const uint16_t push_twice_dest = push_once_dest + push_once;
+                if ((start_rank & BB::square_bb(from_sq)) and !(pos.occupied & BB::square_bb(push_twice_dest)))
+                {
+                    targets |= BB::square_bb(push_twice_dest);
+                }
+            }
+            // Captures
+            targets |= BB::pawn_attacks(side_to_move, from_sq) & pos.pieces(them);
+            targets &= allowed & allowed_targets;
 
-        for(int dir : capture_dirs){
-            int dest_sq = from_sq + dir;
+            while (targets)
+            {
+                generate_pawn_promotions(Move(from_sq, BB::pop_lsb(targets)), side_to_move, move_list);
+            }
 
-            if(dest_sq < 0 or dest_sq >= static_cast<int>(Map::CNT_SQUARES) or FEN::dist(from_sq, dest_sq) > 2){
-                continue;
+            if (T != GenType::QUIETS and
+                pos.enpassant_target_square != static_cast<uint16_t>(Map::CNT_SQUARES) and
+                (BB::pawn_attacks(side_to_move, from_sq) & BB::square_bb(pos.enpassant_target_square)))
+            {
+                // Взятие на проходе снимает с доски сразу две пешки - проверяем короля на полученной занятости
+                const uint16_t ep_sq = pos.enpassant_target_square;
+                const uint16_t captured_sq = ep_sq - push_once;
+                const Bitboard occupied = (pos.occupied ^ BB::square_bb(from_sq) ^ BB::square_bb(captured_sq)) | BB::square_bb(ep_sq);
+                if (!(pos.attackers_to(king_sq, occupied) & pos.pieces(them) & ~BB::square_bb(captured_sq)))
+                {
+                    move_list.push_back(Move(from_sq, ep_sq, MoveType::EN_PASSANT));
+                }
             }
+        }
+    }
 
-            uint16_t captured_idx = pos.board[dest_sq];
+    void generate_pawn_attacks(const Position &pos, uint16_t from_sq, AttacksArray &attacks_list)
+    {
+        // Captures
+        Bitboard targets = pos.attacks_from[from_sq];
+        while (targets)
+        {
+            uint16_t dest_sq = BB::pop_lsb(targets);
             size_t offset = attacks_list.size[dest_sq]++;
-            
+
             if(dest_sq == pos.enpassant_target_square){
                 attacks_list.sq[dest_sq*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ) + offset] = Move(from_sq, dest_sq, MoveType::EN_PASSANT);
             }else{
                 attacks_list.sq[dest_sq*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ) + offset] = Move(from_sq, dest_sq);
             }
-        }    
+        }
     }
 
-    void generate_pawn_promotions(Move move, Color side_to_move, std::vector<MoveInfo> &move_list, std::shared_ptr<AttacksArray> attacksArray)
+    void generate_pawn_promotions(Move move, Color side_to_move, MoveList &move_list)
     {
-        int push_twice_dest = move.dest() + (side_to_move == Color::WHITE ? NORTH : SOUTH);   
-        bool is_promotion = push_twice_dest < 0 or push_twice_dest >= static_cast<int>(Map::CNT_SQUARES);
+        const Bitboard last_rank = side_to_move == Color::WHITE ? BB::RANK_8 : BB::RANK_1;
+        bool is_promotion = last_rank & BB::square_bb(move.dest());
 
         if(is_promotion){
             move.set_promotion(PieceType::QUEEN);
-            move_list.emplace_back(move, attacksArray);
+            move_list.push_back(move);
             move.set_promotion(PieceType::ROOK);
-            move_list.emplace_back(move, attacksArray);
+            move_list.push_back(move);
             move.set_promotion(PieceType::BISHOP);
-            move_list.emplace_back(move, attacksArray);
+            move_list.push_back(move);
             move.set_promotion(PieceType::KNIGHT);
-            move_list.emplace_back(move, attacksArray);
+            move_list.push_back(move);
         }
         else{
-            move_list.emplace_back(move, attacksArray);
+            move_list.push_back(move);
         }
     }
 
-    void generate_sliding_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, const int *directions, int num_directions, AttacksArray &attacks_list)
+    void add_attacks(uint16_t from_sq, Bitboard targets, AttacksArray &attacks_list)
     {
-
-        for (int i = 0; i < num_directions; ++i)
+        while (targets)
         {
-            int direction = directions[i];
-            for (int to_sq = from_sq + direction;
-                 to_sq >= 0 && to_sq < static_cast<int>(Map::CNT_SQUARES);
-                 to_sq += direction)
-            {
-                int dist = FEN::dist(to_sq - direction, to_sq);
-                if (dist > 2) break;
+            uint16_t to_sq = BB::pop_lsb(targets);
+            size_t offset = attacks_list.size[to_sq]++;
+            attacks_list.sq[to_sq*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ)+offset] = Move(from_sq, to_sq);
+        }
+    }
 
-                uint16_t captured_piece_idx = pos.board[to_sq];
-                size_t offset = attacks_list.size[to_sq]++;
-                attacks_list.sq[to_sq*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ)+offset] = Move(from_sq, to_sq);
-                if (captured_piece_idx != static_cast<uint16_t>(Map::CNT_SQUARES))
-                {
-                    break;
-                }
+    // Рокировка i (0 - короткая, 1 - длинная) без учёта шаха королю: его проверяет вызывающий
+    bool can_castle(const Position &pos, Color side_to_move, const CheckInfo &ci, size_t i) {
+        size_t side = static_cast<size_t>(side_to_move);
+        uint16_t king_sq = pos.king_sq[side];
+        if(pos.features & CASTLING_RIGHTS_MASKS[side][i]) {
+            return false;
+        }
+        int  dir = CASTLING_DIRECTION[side][i];
+
+        bool is_free = !(BB::between(king_sq, ROOK_CASTLING_SQ[side][i]) & pos.occupied);
+        // Король не проходит через атакованное поле и не встаёт под шах
+        bool is_safe = !(ci.king_danger & (BB::square_bb(king_sq + dir) | BB::square_bb(king_sq + 2*dir)));
+        return is_free and is_safe;
+    }
+
+    void generate_castling_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list) {
+        size_t side = static_cast<size_t>(side_to_move);
+        uint16_t king_sq = pos.king_sq[side];
+
+        for(size_t i = 0; i < CASTLE_N; ++i) {
+            if(can_castle(pos, side_to_move, ci, i)){
+                move_list.push_back(Move(king_sq, king_sq + 2*CASTLING_DIRECTION[side][i], MoveType::CASTLING));
             }
         }
     }
 
-    void generate_leaping_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, const int *directions, int num_directions, AttacksArray &attacks_list)
+    bool is_legal(const Position &pos, const CheckInfo &ci, Move move)
     {
-        for (int i = 0; i < num_directions; ++i)
+        const Color us = static_cast<Color>(Position::get_side_to_move(pos));
+        const Color them = static_cast<Color>(static_cast<uint16_t>(us) ^ 1);
+        const uint16_t from_sq = move.source();
+        const uint16_t to_sq = move.dest();
+        const uint16_t king_sq = pos.king_sq[static_cast<size_t>(us)];
+        const Bitboard to_bb = BB::square_bb(to_sq);
+
+        // Биты фигуры превращения у остальных типов ходов генератор всегда оставляет нулевыми
+        const bool stray_promotion_bits = move.type() != MoveType::PROMOTION and (move.data & static_cast<uint16_t>(MoveType::PROMOTION_MASK));
+        if (stray_promotion_bits or !(pos.pieces(us) & BB::square_bb(from_sq)) or (pos.pieces(us) & to_bb))
         {
-            int to_sq = from_sq + directions[i];
-
-            if (to_sq < 0 || to_sq >= static_cast<int>(Map::CNT_SQUARES) || FEN::dist(from_sq, to_sq) > 3) continue;
+            return false;
+        }
+        const PieceType pt = FEN::get_piece_type(pos.piece_on(from_sq));
 
-            uint16_t captured_piece_idx = pos.board[to_sq];
-            // Если поле пустое или занято фигурой противника
-            if (captured_piece_idx == static_cast<uint16_t>(Map::CNT_SQUARES) || FEN::get_piece_color(pos.pieces_list[captured_piece_idx].type) != side_to_move)
+        if (move.type() == MoveType::CASTLING)
+        {
+            if (pt != PieceType::KING or ci.checkers)
             {
-                size_t offset = attacks_list.size[to_sq]++;
-                attacks_list.sq[to_sq*static_cast<size_t>(Map::MAX_ATTACKS_PER_SQ)+offset] = Move(from_sq, to_sq);
+                return false;
             }
+            for (size_t i = 0; i < CASTLE_N; ++i)
+            {
+                if (to_sq == king_sq + 2 * CASTLING_DIRECTION[static_cast<size_t>(us)][i])
+                {
+                    return can_castle(pos, us, ci, i);
+                }
+            }
+            return false;
         }
-    }
 
+        if (pt == PieceType::KING)
+        {
+            return move.type() == MoveType::NORMAL and (BB::KingAttacks[king_sq] & to_bb & ~ci.king_danger);
+        }
 
-    void generate_castling_moves(Position &pos, Color side_to_move, const AttacksArray &attacks_list, std::vector<MoveInfo> &move_list) {
-        size_t side = static_cast<size_t>(side_to_move);
+        // Не король: при двойном шахе нельзя, иначе цель в маске шаха, связанная фигура - вдоль связки
+        Bitboard allowed = ci.check_mask;
+        if (ci.pinned & BB::square_bb(from_sq))
+        {
+            allowed &= BB::line(king_sq, from_sq);
+        }
 
-        for(size_t i = 0; i < CASTLE_N; ++i) {
-            if(!(pos.features & CASTLING_RIGHTS_MASKS[side][i])) {
-                int  dir = CASTLING_DIRECTION[side][i];
-                uint16_t king_sq = pos.king_sq[side];
-                
-                bool is_free = true;
-                uint16_t target_sq = ROOK_CASTLING_SQ[side][i];
-                for(uint16_t i = king_sq+dir; i != target_sq; i += dir) {
-                    if(pos.board[i] != static_cast<uint16_t>(Map::CNT_SQUARES)) {
-                        is_free = false;
-                        break;
-                    }
-                }
-                
-                if(is_free){
-                    Move m = Move(king_sq, king_sq + 2*dir, MoveType::CASTLING);
-                    auto next_attacks = std::make_shared<AttacksArray>();
-
-                    if(is_legal(m, pos, attacks_list, *next_attacks) and !next_attacks->size[king_sq] and !next_attacks->size[king_sq + dir]) {
-                        move_list.emplace_back(m, next_attacks);
-                    }
-                }
-            }
+        if (pt != PieceType::PAWN)
+        {
+            return move.type() == MoveType::NORMAL and (pos.attacks_from[from_sq] & to_bb & allowed);
         }
-    }
 
-    bool is_legal(const Move move, Position &pos, const AttacksArray &attacks_list, AttacksArray &next_attacks) {
-        uint16_t side_bit_before_move = static_cast<uint16_t>(Position::get_side_to_move(pos));
-        bool legal = true;
-        // if(std::string(FEN::index_to_square(move.source()))+ std::string(FEN::index_to_square(move.dest())) == "f4g3"){
-        //     std::println("{}", pos);
-        //     std::println("{:l}", pos);
-        // }
-        pos.do_move(move);
-        // if(std::string(FEN::index_to_square(move.source()))+ std::string(FEN::index_to_square(move.dest())) == "f4g3"){
-        //     std::println("{}", pos);
-        //     std::println("{:l}", pos);
-        //     std::println("{}", pos.board[FEN::square_to_index("g4")]);
-        // }
-        Color side_to_move = static_cast<Color>(Position::get_side_to_move(pos));
-        generate_attacks(pos, side_to_move,  next_attacks);
+        const int push_once = us == Color::WHITE ? NORTH : SOUTH;
+        const Bitboard start_rank = us == Color::WHITE ? BB::RANK_2 : BB::RANK_7;
+        const Bitboard last_rank = us == Color::WHITE ? BB::RANK_8 : BB::RANK_1;
 
-        if(next_attacks.size[pos.king_sq[side_bit_before_move]]){
-            legal = false;
+        if (move.type() == MoveType::EN_PASSANT)
+        {
+            if (to_sq != pos.enpassant_target_square or !(BB::pawn_attacks(us, from_sq) & to_bb))
+            {
+                return false;
+            }
+            const uint16_t captured_sq = to_sq - push_once;
+            const Bitboard occupied = (pos.occupied ^ BB::square_bb(from_sq) ^ BB::square_bb(captured_sq)) | to_bb;
+            return !(pos.attackers_to(king_sq, occupied) & pos.pieces(them) & ~BB::square_bb(captured_sq));
         }
-        pos.undo_move();
-        return legal;
+
+        // Превращение обязательно на последней горизонтали и только там
+        if ((move.type() == MoveType::PROMOTION) != static_cast<bool>(last_rank & to_bb))
+        {
+            return false;
+        }
+
+        const bool is_capture = BB::pawn_attacks(us, from_sq) & pos.pieces(them) & to_bb;
+        const bool is_single_push = to_sq == from_sq + push_once and !(pos.occupied & to_bb);
+        const bool is_double_push = (start_rank & BB::square_bb(from_sq)) and to_sq == from_sq + 2 * push_once and
+                                    !(pos.occupied & (to_bb | BB::square_bb(from_sq + push_once)));
+        return (is_capture or is_single_push or is_double_push) and (allowed & to_bb);
     }
-}
\ No newline at end of file
+}
@@ -10,23 +10,81 @@ namespace MoveGen
         std::array<size_t, static_cast<size_t>(Map::CNT_SQUARES)> size;
     };
 
+    // Ход и ключ упорядочивания (заполняет MovePicker) в одном 32-битном слове
     struct MoveInfo{
         Move move;
-        std::shared_ptr<AttacksArray> attacks_list;
+        int16_t score;
     };
+    static_assert(sizeof(MoveInfo) == 4);
 
-    using PawnQuiteMoves = std::array<Move, static_cast<size_t>(Map::CNT_SQUARES)>;
-    
-    void generate_moves(Position &pos, AttacksArray &attacks_list, std::vector<MoveInfo> &move_list);
-    void generate_pawn_moves(const Position &pos, Color side_to_move, uint16_t from_sq, PawnQuiteMoves &move_list);
-    void generate_castling_moves(Position &pos, Color side_to_move, const AttacksArray &attacks_list, std::vector<MoveInfo> &move_list);
+    // Ходы одной позиции во встроенном массиве на MAX_MOVES записей (872 байта): без обращений к куче,
+    // весь список лежит подряд и при генерации и переборе не выходит из L1
+    class MoveList{
+    public:
+        void push_back(Move move) { entries[count++] = {move, 0}; }
+        void clear() { count = 0; }
+        // Только укорачивает список
+        void resize(size_t n) { count = static_cast<uint32_t>(n); }
 
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        MoveInfo &operator[](size_t i) { return entries[i]; }
+        const MoveInfo &operator[](size_t i) const { return entries[i]; }
+        MoveInfo &front() { return entries[0]; }
+
+        MoveInfo *begin() { return entries.data(); }
+        MoveInfo *end() { return entries.data() + count; }
+        const MoveInfo *begin() const { return entries.data(); }
+        const MoveInfo *end() const { return entries.data() + count; }
+
+    private:
+        std::array<MoveInfo, static_cast<size_t>(Map::MAX_MOVES)> entries;
+        uint32_t count = 0;
+    };
+
+    // Стек списков по уровням, принадлежит тому, кто обходит дерево (perft, поиск)
+    using MoveStack = std::array<MoveList, static_cast<size_t>(Map::MAX_PLY)>;
+
+    // Считается один раз на позицию: по нему легальность любого хода кроме взятия на проходе проверяется масками
+    struct CheckInfo{
+        Bitboard checkers;    // фигуры противника, объявившие шах
+        Bitboard pinned;      // свои фигуры, связанные с собственным королём
+        Bitboard check_mask;  // поля, куда может пойти не король: всё, перекрытие/взятие шахующей или ничего при двойном шахе
+        Bitboard king_danger; // поля под боем противника, если убрать нашего короля с доски
+    };
+
+    CheckInfo compute_check_info(const Position &pos, Color side_to_move);
+
+    // Что генерировать. CAPTURES - взятия, взятие на проходе и все превращения; QUIETS - остальное; LEGAL - всё сразу.
+    // CAPTURES и QUIETS не пересекаются и вместе дают LEGAL
+    enum class GenType
+    {
+        CAPTURES,
+        QUIETS,
+        LEGAL,
+    };
+
+    // Генерирует только легальные ходы, позицию не изменяет
+    void generate_moves(const Position &pos, MoveList &move_list);
+    template <GenType T>
+    void generate(const Position &pos, const CheckInfo &ci, MoveList &move_list);
+    template <GenType T>
+    void generate_piece_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list);
+    template <GenType T>
+    void generate_king_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list);
+    template <GenType T>
+    void generate_pawn_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list);
+    void generate_pawn_promotions(Move move, Color side_to_move, MoveList &move_list);
+    void generate_castling_moves(const Position &pos, Color side_to_move, const CheckInfo &ci, MoveList &move_list);
+    bool can_castle(const Position &pos, Color side_to_move, const CheckInfo &ci, size_t i);
+
+    // Легален ли произвольный ход в позиции: для ходов не из генератора - из TT, киллеров
+    bool is_legal(const Position &pos, const CheckInfo &ci, Move move);
+
+    // Карта атак по полям из инкрементальных Position::attacks_from - для отладочного вывода
     void generate_attacks(const Position &pos, Color side_to_move, AttacksArray &attacks_list);
-    void generate_pawn_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, AttacksArray &attacks_list);
-    void generate_pawn_promotions(Move move, Color side_to_move, std::vector<MoveInfo> &move_list, std::shared_ptr<AttacksArray> attacksArray);
-    void generate_sliding_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, const int *directions, int num_directions, AttacksArray &attacks_list);
-    void generate_leaping_attacks(const Position &pos, Color side_to_move, uint16_t from_sq, const int *directions, int num_directions, AttacksArray &attacks_list);
-    bool is_legal(const Move move, Position &pos, const AttacksArray &attacks_list, AttacksArray &next_attacks);
+    void generate_pawn_attacks(const Position &pos, uint16_t from_sq, AttacksArray &attacks_list);
+    void add_attacks(uint16_t from_sq, Bitboard targets, AttacksArray &attacks_list);
 }
 
 template <>
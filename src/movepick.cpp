@@ -0,0 +1,242 @@
+#include "movepick.hpp"
+#include "evaluate.hpp"
+#include "see.hpp"
+
+namespace MovePick
+{
+    void Heuristics::clear()
+    {
+        for (auto &side : history)
+        {
+            for (auto &from : side)
+            {
+                from.fill(0);
+            }
+        }
+        for (auto &piece : countermoves)
+        {
+            piece.fill(Move::none());
+        }
+        killers.fill({Move::none(), Move::none()});
+    }
+
+    void Heuristics::age()
+    {
+        for (auto &side : history)
+        {
+            for (auto &from : side)
+            {
+                for (int16_t &value : from)
+                {
+                    value /= 2;
+                }
+            }
+        }
+        killers.fill({Move::none(), Move::none()});
+    }
+
+    void Heuristics::update_history(Color side, Move move, int bonus)
+    {
+        // Притяжение к нулю: чем больше значение, тем меньше его сдвигает очередной бонус
+        int16_t &entry = history[static_cast<size_t>(side)][move.source()][move.dest()];
+        bonus = std::clamp(bonus, -HISTORY_MAX, HISTORY_MAX);
+        entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+    }
+
+    void Heuristics::update_killers(int ply, Move move)
+    {
+        if (killers[ply][0] != move)
+        {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
+        }
+    }
+
+    Move Heuristics::countermove(const Position &pos) const
+    {
+        const Move prev = pos.state()->move;
+        if (prev == Move::none())
+        {
+            return Move::none();
+        }
+        const uint16_t prev_to = prev.dest();
+        return countermoves[pos.piece_on(prev_to)][prev_to];
+    }
+
+    void Heuristics::update_countermove(const Position &pos, Move move)
+    {
+        const Move prev = pos.state()->move;
+        if (prev != Move::none())
+        {
+            const uint16_t prev_to = prev.dest();
+            countermoves[pos.piece_on(prev_to)][prev_to] = move;
+        }
+    }
+
+    template <MoveGen::GenType T>
+    MovePicker<T>::MovePicker(const Position &pos, Move tt_move, const Heuristics &heuristics, int ply, MoveGen::MoveList &buffer)
+        : pos(pos), ci(MoveGen::compute_check_info(pos, static_cast<Color>(Position::get_side_to_move(pos)))),
+          heuristics(heuristics), tt_move(tt_move),
+          refutations{heuristics.killers[ply][0], heuristics.killers[ply][1], heuristics.countermove(pos)},
+          moves(buffer)
+    {
+        // Ход из TT мог прийти из другой позиции с тем же индексом - проверяем до того, как выдать
+        if (tt_move == Move::none() or !MoveGen::is_legal(pos, ci, tt_move) or
+            (T == MoveGen::GenType::CAPTURES and !is_capture(tt_move)))
+        {
+            this->tt_move = Move::none();
+            stage = Stage::GEN_CAPTURES;
+        }
+        // Ответный ход, совпавший с киллером, второй раз не выдаём
+        if (refutations[2] == refutations[0] or refutations[2] == refutations[1])
+        {
+            refutations[2] = Move::none();
+        }
+    }
+
+    template <MoveGen::GenType T>
+    bool MovePicker<T>::is_capture(Move move) const
+    {
+        const Color them = static_cast<Color>(!Position::get_side_to_move(pos));
+        return move.type() == MoveType::PROMOTION or move.type() == MoveType::EN_PASSANT or
+               (pos.pieces(them) & BB::square_bb(move.dest()));
+    }
+
+    template <MoveGen::GenType T>
+    void MovePicker<T>::score_captures()
+    {
+        // MVV-LVA: сначала самая ценная жертва, среди равных - самым дешёвым нападающим.
+        // Коды фигур берём из pieces_list; у взятия на проходе поле назначения пусто - жертва пешка
+        for (MoveGen::MoveInfo &mi : moves)
+        {
+            const Move move = mi.move;
+            const PieceType victim = move.type() == MoveType::EN_PASSANT ? PieceType::PAWN : FEN::get_piece_type(pos.piece_on(move.dest()));
+            const PieceType attacker = FEN::get_piece_type(pos.piece_on(move.source()));
+            mi.score = 16 * Eval::PIECE_VALUE[static_cast<size_t>(victim)] - Eval::PIECE_VALUE[static_cast<size_t>(attacker)];
+            if (move.type() == MoveType::PROMOTION)
+            {
+                mi.score += 16 * Eval::PIECE_VALUE[static_cast<size_t>(move.promotion_piece())];
+            }
+        }
+    }
+
+    template <MoveGen::GenType T>
+    void MovePicker<T>::score_quiets()
+    {
+        const auto &side_history = heuristics.history[Position::get_side_to_move(pos)];
+        for (MoveGen::MoveInfo &mi : moves | std::views::drop(bad_captures_end))
+        {
+            mi.score = side_history[mi.move.source()][mi.move.dest()];
+        }
+    }
+
+    template <MoveGen::GenType T>
+    Move MovePicker<T>::select_best()
+    {
+        while (cur < moves.size())
+        {
+            auto best = std::max_element(moves.begin() + cur, moves.end(),
+                                         [](const MoveGen::MoveInfo &a, const MoveGen::MoveInfo &b) { return a.score < b.score; });
+            std::iter_swap(moves.begin() + cur, best);
+            const Move move = moves[cur++].move;
+            if (move != tt_move)
+            {
+                return move;
+            }
+        }
+        return Move::none();
+    }
+
+    template <MoveGen::GenType T>
+    Move MovePicker<T>::next_move()
+    {
+        while (true)
+        {
+            switch (stage)
+            {
+            case Stage::TT_MOVE:
+                stage = Stage::GEN_CAPTURES;
+                return tt_move;
+
+            case Stage::GEN_CAPTURES:
+                moves.clear();
+                MoveGen::generate<MoveGen::GenType::CAPTURES>(pos, ci, moves);
+                score_captures();
+                cur = 0;
+                stage = Stage::CAPTURES;
+                break;
+
+            case Stage::CAPTURES:
+                for (Move move = select_best(); move != Move::none(); move = select_best())
+                {
+                    if (SEE::see(pos, move, 0))
+                    {
+                        return move;
+                    }
+                    moves[bad_captures_end++] = moves[cur - 1];
+                }
+                moves.resize(bad_captures_end);
+                stage = T == MoveGen::GenType::CAPTURES ? Stage::END : Stage::REFUTATIONS;
+                break;
+
+            case Stage::REFUTATIONS:
+                // Взятия среди них уже выданы на прошлой стадии
+                while (refutation_index < refutations.size())
+                {
+                    const Move move = refutations[refutation_index++];
+                    if (move != Move::none() and move != tt_move and !is_capture(move) and MoveGen::is_legal(pos, ci, move))
+                    {
+                        return move;
+                    }
+                }
+                stage = Stage::GEN_QUIETS;
+                break;
+
+            case Stage::GEN_QUIETS:
+                MoveGen::generate<MoveGen::GenType::QUIETS>(pos, ci, moves);
+                score_quiets();
+                // Тихих ходов много, и до конца их перебирают только в узлах без отсечения - сортируем вставками сразу
+                for (size_t i = bad_captures_end + 1; i < moves.size(); ++i)
+                {
+                    const MoveGen::MoveInfo mi = moves[i];
+                    size_t j = i;
+                    for (; j > bad_captures_end and moves[j - 1].score < mi.score; --j)
+                    {
+                        moves[j] = moves[j - 1];
+                    }
+                    moves[j] = mi;
+                }
+                cur = bad_captures_end;
+                stage = Stage::QUIETS;
+                break;
+
+            case Stage::QUIETS:
+                while (cur < moves.size())
+                {
+                    const Move move = moves[cur++].move;
+                    if (move != tt_move and std::ranges::find(refutations, move) == refutations.end())
+                    {
+                        return move;
+                    }
+                }
+                cur = 0;
+                stage = Stage::BAD_CAPTURES;
+                break;
+
+            case Stage::BAD_CAPTURES:
+                if (cur < bad_captures_end)
+                {
+                    return moves[cur++].move;
+                }
+                stage = Stage::END;
+                break;
+
+            case Stage::END:
+                return Move::none();
+            }
+        }
+    }
+
+    template class MovePicker<MoveGen::GenType::CAPTURES>;
+    template class MovePicker<MoveGen::GenType::LEGAL>;
+} // namespace MovePick
@@ -0,0 +1,77 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include "movegen.hpp"
+#include <bits/stdc++.h>
+
+namespace MovePick
+{
+    // Предел модуля истории: обновление "с притяжением" не даёт значениям выйти за него
+    constexpr int HISTORY_MAX = 16384;
+
+    // Эвристики упорядочивания одного потока поиска. Живут между поисками, чтобы их можно было старить,
+    // и целиком помещаются в L1/L2: история 16 КБ, ответные ходы 2 КБ
+    struct Heuristics
+    {
+        // Бабочка: [цвет][откуда][куда] - насколько часто тихий ход давал отсечение
+        std::array<std::array<std::array<int16_t, static_cast<size_t>(Map::CNT_SQUARES)>, static_cast<size_t>(Map::CNT_SQUARES)>, 2> history;
+        // Ответный ход на последний ход соперника: [код фигуры][поле, куда она пошла]
+        std::array<std::array<Move, static_cast<size_t>(Map::CNT_SQUARES)>, 16> countermoves;
+        // Два последних тихих хода, давших отсечение на каждом уровне
+        std::array<std::array<Move, 2>, static_cast<size_t>(Map::MAX_PLY)> killers;
+
+        void clear();
+        // Перед каждым поиском: история ослабляется вдвое, киллеры привязаны к уровню и сбрасываются
+        void age();
+
+        void update_history(Color side, Move move, int bonus);
+        void update_killers(int ply, Move move);
+        // Ответный ход на последний ход в позиции, Move::none(), если ходов не было
+        Move countermove(const Position &pos) const;
+        void update_countermove(const Position &pos, Move move);
+    };
+
+    enum class Stage
+    {
+        TT_MOVE,
+        GEN_CAPTURES,
+        CAPTURES,
+        REFUTATIONS,
+        GEN_QUIETS,
+        QUIETS,
+        BAD_CAPTURES,
+        END,
+    };
+
+    // Выдаёт ходы по стадиям: ход из TT, выгодные по SEE взятия по MVV-LVA, киллеры и ответный ход, тихие по истории,
+    // проигрывающие взятия. Стадия генерируется, только когда исчерпана предыдущая: при отсечении на первых ходах
+    // тихие ходы не строятся вовсе. T = CAPTURES - только ход из TT (если это взятие) и выгодные взятия:
+    // проигрывающие в форсированном поиске отбрасываются
+    template <MoveGen::GenType T>
+    class MovePicker
+    {
+    public:
+        MovePicker(const Position &pos, Move tt_move, const Heuristics &heuristics, int ply, MoveGen::MoveList &buffer);
+
+        // Следующий легальный ход или Move::none(), когда ходы кончились
+        Move next_move();
+
+    private:
+        bool is_capture(Move move) const;
+        void score_captures();
+        void score_quiets();
+        // Выбирает лучший из оставшихся: взятий мало и отсечение обычно на первых, полная сортировка не нужна
+        Move select_best();
+
+        const Position &pos;
+        const MoveGen::CheckInfo ci;
+        const Heuristics &heuristics;
+        Move tt_move;
+        std::array<Move, 3> refutations; // два киллера и ответный ход
+        MoveGen::MoveList &moves;
+        size_t cur = 0;
+        size_t bad_captures_end = 0; // проигрывающие взятия копятся в начале буфера, тихие генерируются после них
+        size_t refutation_index = 0;
+        Stage stage = Stage::TT_MOVE;
+    };
+} // namespace MovePick
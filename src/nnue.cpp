@@ -0,0 +1,370 @@
+#include "nnue.hpp"
+#include "position.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NNUE_X86
+#include <immintrin.h>
+#endif
+
+namespace NNUE
+{
+    namespace
+    {
+        // Формат файла (little-endian): заголовок 64 байта, затем массивы весов, каждый с границы 64 байт.
+        // Массивы используются прямо из отображения, без копирования
+        constexpr uint32_t MAGIC = 0x4E4E4644; // "DFNN"
+        constexpr uint32_t VERSION = 1;
+
+        constexpr size_t align_up(size_t offset) { return (offset + 63) & ~size_t{63}; }
+
+        constexpr size_t HEADER_SIZE = 64;
+        constexpr size_t FT_WEIGHTS_OFFSET = HEADER_SIZE;                                                  // int16 [INPUTS][HIDDEN]
+        constexpr size_t FT_BIASES_OFFSET = align_up(FT_WEIGHTS_OFFSET + INPUTS * HIDDEN * sizeof(int16_t)); // int16 [HIDDEN]
+        constexpr size_t L1_WEIGHTS_OFFSET = align_up(FT_BIASES_OFFSET + HIDDEN * sizeof(int16_t));         // int8 [L1_OUT][2 * HIDDEN]
+        constexpr size_t L1_BIASES_OFFSET = align_up(L1_WEIGHTS_OFFSET + L1_OUT * 2 * HIDDEN);              // int32 [L1_OUT]
+        constexpr size_t L2_WEIGHTS_OFFSET = align_up(L1_BIASES_OFFSET + L1_OUT * sizeof(int32_t));         // int8 [L1_OUT]
+        constexpr size_t L2_BIAS_OFFSET = align_up(L2_WEIGHTS_OFFSET + L1_OUT);                             // int32
+        constexpr size_t FILE_SIZE = align_up(L2_BIAS_OFFSET + sizeof(int32_t));
+
+        struct Network
+        {
+            const int16_t *ft_weights = nullptr;
+            const int16_t *ft_biases = nullptr;
+            const int8_t *l1_weights = nullptr;
+            const int32_t *l1_biases = nullptr;
+            const int8_t *l2_weights = nullptr;
+            int32_t l2_bias = 0;
+        };
+
+        Network g_net;
+        void *g_mapping = nullptr;
+        std::string g_file;
+
+        inline size_t feature_index(Color perspective, uint16_t piece_code, uint16_t sq)
+        {
+            const size_t relative_color = FEN::get_piece_color(piece_code) != perspective;
+            const size_t type = static_cast<size_t>(FEN::get_piece_type(piece_code)) - static_cast<size_t>(PieceType::KING);
+            const size_t relative_sq = perspective == Color::WHITE ? sq : sq ^ 56;
+            return (relative_color * 6 + type) * static_cast<size_t>(Map::CNT_SQUARES) + relative_sq;
+        }
+
+        // Ядра в трёх вариантах. Рабочий выбирается флагами сборки (AVX2=1, SSE4=1); SIMD-варианты собираются
+        // всегда, с атрибутом target, чтобы verify() сверял со скалярным каждый, который поддерживает процессор
+        struct Scalar
+        {
+            // dst = src + sum(add) - sum(sub), один проход по аккумулятору; dst может совпадать с src
+            static void apply_columns(int16_t *dst, const int16_t *src, const int16_t *const *add, size_t cnt_add,
+                                      const int16_t *const *sub, size_t cnt_sub)
+            {
+                for (size_t i = 0; i < HIDDEN; ++i)
+                {
+                    int16_t v = src[i];
+                    for (size_t k = 0; k < cnt_add; ++k) v += add[k][i];
+                    for (size_t k = 0; k < cnt_sub; ++k) v -= sub[k][i];
+                    dst[i] = v;
+                }
+            }
+
+            // Clipped ReLU: int16 -> [0, ACTIVATION_MAX] в uint8
+            static void clipped_relu(const int16_t *in, uint8_t *out)
+            {
+                for (size_t i = 0; i < HIDDEN; ++i)
+                {
+                    out[i] = static_cast<uint8_t>(std::clamp<int>(in[i], 0, ACTIVATION_MAX));
+                }
+            }
+
+            // Скалярное произведение uint8 x int8, n кратно 32
+            static int32_t dot_u8_i8(const uint8_t *in, const int8_t *w, size_t n)
+            {
+                int32_t sum = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    sum += static_cast<int32_t>(in[i]) * w[i];
+                }
+                return sum;
+            }
+        };
+
+#ifdef NNUE_X86
+        struct Sse41
+        {
+            __attribute__((target("sse4.1"))) static void apply_columns(int16_t *dst, const int16_t *src, const int16_t *const *add, size_t cnt_add,
+                                                                       const int16_t *const *sub, size_t cnt_sub)
+            {
+                for (size_t i = 0; i < HIDDEN; i += 8)
+                {
+                    __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(src + i));
+                    for (size_t k = 0; k < cnt_add; ++k)
+                        v = _mm_add_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(add[k] + i)));
+                    for (size_t k = 0; k < cnt_sub; ++k)
+                        v = _mm_sub_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(sub[k] + i)));
+                    _mm_store_si128(reinterpret_cast<__m128i *>(dst + i), v);
+                }
+            }
+
+            __attribute__((target("sse4.1"))) static void clipped_relu(const int16_t *in, uint8_t *out)
+            {
+                const __m128i max = _mm_set1_epi16(ACTIVATION_MAX);
+                for (size_t i = 0; i < HIDDEN; i += 16)
+                {
+                    __m128i a = _mm_min_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(in + i)), max);
+                    __m128i b = _mm_min_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(in + i + 8)), max);
+                    _mm_store_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(a, b));
+                }
+            }
+
+            // Входы не больше ACTIVATION_MAX, поэтому попарные суммы в maddubs не насыщаются
+            __attribute__((target("sse4.1"))) static int32_t dot_u8_i8(const uint8_t *in, const int8_t *w, size_t n)
+            {
+                const __m128i ones = _mm_set1_epi16(1);
+                __m128i sum = _mm_setzero_si128();
+                for (size_t i = 0; i < n; i += 16)
+                {
+                    __m128i products = _mm_maddubs_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(in + i)),
+                                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(w + i)));
+                    sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+                }
+                sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+                sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+                return _mm_cvtsi128_si32(sum);
+            }
+        };
+
+        struct Avx2
+        {
+            __attribute__((target("avx2"))) static void apply_columns(int16_t *dst, const int16_t *src, const int16_t *const *add, size_t cnt_add,
+                                                                     const int16_t *const *sub, size_t cnt_sub)
+            {
+                for (size_t i = 0; i < HIDDEN; i += 16)
+                {
+                    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(src + i));
+                    for (size_t k = 0; k < cnt_add; ++k)
+                        v = _mm256_add_epi16(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(add[k] + i)));
+                    for (size_t k = 0; k < cnt_sub; ++k)
+                        v = _mm256_sub_epi16(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sub[k] + i)));
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(dst + i), v);
+                }
+            }
+
+            __attribute__((target("avx2"))) static void clipped_relu(const int16_t *in, uint8_t *out)
+            {
+                const __m256i max = _mm256_set1_epi16(ACTIVATION_MAX);
+                for (size_t i = 0; i < HIDDEN; i += 32)
+                {
+                    __m256i a = _mm256_min_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(in + i)), max);
+                    __m256i b = _mm256_min_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(in + i + 16)), max);
+                    // packus работает внутри 128-битных половин, перестановка возвращает порядок
+                    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(out + i), packed);
+                }
+            }
+
+            __attribute__((target("avx2"))) static int32_t dot_u8_i8(const uint8_t *in, const int8_t *w, size_t n)
+            {
+                const __m256i ones = _mm256_set1_epi16(1);
+                __m256i sum = _mm256_setzero_si256();
+                for (size_t i = 0; i < n; i += 32)
+                {
+                    __m256i products = _mm256_maddubs_epi16(_mm256_load_si256(reinterpret_cast<const __m256i *>(in + i)),
+                                                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + i)));
+                    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+                }
+                __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+                s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+                s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+                return _mm_cvtsi128_si32(s);
+            }
+        };
+#endif
+
+#if defined(__AVX2__)
+        using Kernels = Avx2;
+#elif defined(__SSE4_1__)
+        using Kernels = Sse41;
+#else
+        using Kernels = Scalar;
+#endif
+
+        template <typename K>
+        void refresh_with(const Position &pos, Accumulator &acc)
+        {
+            for (Color perspective : {Color::WHITE, Color::BLACK})
+            {
+                int16_t *values = acc.values[static_cast<size_t>(perspective)].data();
+                std::memcpy(values, g_net.ft_biases, HIDDEN * sizeof(int16_t));
+                for (uint16_t i = 0; i < pos.end_pieces_list; ++i)
+                {
+                    const int16_t *column = g_net.ft_weights + feature_index(perspective, pos.pieces_list[i].type, pos.pieces_list[i].position) * HIDDEN;
+                    K::apply_columns(values, values, &column, 1, nullptr, 0);
+                }
+            }
+        }
+
+        template <typename K>
+        void update_with(Accumulator &acc, const Accumulator &prev, const DirtyPieces &dirty)
+        {
+            for (Color perspective : {Color::WHITE, Color::BLACK})
+            {
+                std::array<const int16_t *, 2> add{}, sub{};
+                for (size_t k = 0; k < dirty.cnt_added; ++k)
+                    add[k] = g_net.ft_weights + feature_index(perspective, dirty.added[k].piece_code, dirty.added[k].sq) * HIDDEN;
+                for (size_t k = 0; k < dirty.cnt_removed; ++k)
+                    sub[k] = g_net.ft_weights + feature_index(perspective, dirty.removed[k].piece_code, dirty.removed[k].sq) * HIDDEN;
+
+                const size_t p = static_cast<size_t>(perspective);
+                K::apply_columns(acc.values[p].data(), prev.values[p].data(), add.data(), dirty.cnt_added, sub.data(), dirty.cnt_removed);
+            }
+        }
+
+        // us - сторона, чья очередь хода: её перспектива идёт первой
+        template <typename K>
+        int evaluate_with(const Accumulator &acc, size_t us)
+        {
+            alignas(64) std::array<uint8_t, 2 * HIDDEN> input;
+            K::clipped_relu(acc.values[us].data(), input.data());
+            K::clipped_relu(acc.values[us ^ 1].data(), input.data() + HIDDEN);
+
+            alignas(64) std::array<uint8_t, L1_OUT> hidden;
+            for (size_t j = 0; j < L1_OUT; ++j)
+            {
+                const int32_t v = g_net.l1_biases[j] + K::dot_u8_i8(input.data(), g_net.l1_weights + j * 2 * HIDDEN, 2 * HIDDEN);
+                hidden[j] = static_cast<uint8_t>(std::clamp(v >> L1_SHIFT, 0, ACTIVATION_MAX));
+            }
+
+            const int32_t output = g_net.l2_bias + K::dot_u8_i8(hidden.data(), g_net.l2_weights, L1_OUT);
+            return std::clamp(output / OUTPUT_SCALE, -MAX_SCORE, MAX_SCORE);
+        }
+
+        // Сверка варианта ядер K со скалярным: полный пересчёт, снятие фигуры и оценка. Возвращает число расхождений
+        template <typename K>
+        int compare_kernels(const Position &pos, const Accumulator &reference, int expected)
+        {
+            int mismatches = 0;
+            Accumulator acc;
+            refresh_with<K>(pos, acc);
+            mismatches += acc.values != reference.values;
+            mismatches += evaluate_with<K>(acc, Position::get_side_to_move(pos)) != expected;
+
+            DirtyPieces dirty;
+            dirty.remove(pos.pieces_list[0].type, pos.pieces_list[0].position);
+            Accumulator removed, removed_reference;
+            update_with<K>(removed, reference, dirty);
+            update_with<Scalar>(removed_reference, reference, dirty);
+            mismatches += removed.values != removed_reference.values;
+            return mismatches;
+        }
+    } // namespace
+
+    bool load(std::string_view path)
+    {
+        const std::string file(path);
+        const int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != FILE_SIZE)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = ::mmap(nullptr, FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // отображение остаётся действительным и после закрытия дескриптора
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const char *base = static_cast<const char *>(mapping);
+        uint32_t magic = 0, version = 0;
+        std::memcpy(&magic, base, sizeof(magic));
+        std::memcpy(&version, base + sizeof(magic), sizeof(version));
+        if (magic != MAGIC || version != VERSION)
+        {
+            ::munmap(mapping, FILE_SIZE);
+            return false;
+        }
+
+        if (g_mapping)
+        {
+            ::munmap(g_mapping, FILE_SIZE);
+        }
+        g_mapping = mapping;
+        g_file = file;
+        g_net.ft_weights = reinterpret_cast<const int16_t *>(base + FT_WEIGHTS_OFFSET);
+        g_net.ft_biases = reinterpret_cast<const int16_t *>(base + FT_BIASES_OFFSET);
+        g_net.l1_weights = reinterpret_cast<const int8_t *>(base + L1_WEIGHTS_OFFSET);
+        g_net.l1_biases = reinterpret_cast<const int32_t *>(base + L1_BIASES_OFFSET);
+        g_net.l2_weights = reinterpret_cast<const int8_t *>(base + L2_WEIGHTS_OFFSET);
+        std::memcpy(&g_net.l2_bias, base + L2_BIAS_OFFSET, sizeof(g_net.l2_bias));
+        return true;
+    }
+
+    bool is_loaded() { return g_mapping != nullptr; }
+
+    const std::string &loaded_file() { return g_file; }
+
+    void refresh(const Position &pos, Accumulator &acc) { refresh_with<Kernels>(pos, acc); }
+
+    void update(Accumulator &acc, const Accumulator &prev, const DirtyPieces &dirty) { update_with<Kernels>(acc, prev, dirty); }
+
+    int evaluate(const Position &pos) { return evaluate_with<Kernels>(pos.accumulators.back(), Position::get_side_to_move(pos)); }
+
+    int verify(const Position &pos)
+    {
+        Accumulator reference;
+        refresh_with<Scalar>(pos, reference);
+        const int expected = evaluate_with<Scalar>(reference, Position::get_side_to_move(pos));
+
+        int mismatches = 0;
+        mismatches += pos.accumulators.back().values != reference.values;
+        mismatches += evaluate(pos) != expected;
+#ifdef NNUE_X86
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            mismatches += compare_kernels<Sse41>(pos, reference, expected);
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            mismatches += compare_kernels<Avx2>(pos, reference, expected);
+        }
+#endif
+        return mismatches;
+    }
+
+    bool write_random(std::string_view path, uint64_t seed)
+    {
+        std::vector<char> data(FILE_SIZE, 0);
+        std::memcpy(data.data(), &MAGIC, sizeof(MAGIC));
+        std::memcpy(data.data() + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+
+        // Равномерно в [-range, range]. Диапазоны подобраны так, чтобы аккумулятор не переполнялся,
+        // а clipped ReLU срезал значения с обеих сторон
+        BB::PRNG rng{seed};
+        auto fill = [&]<typename T>(size_t offset, size_t count, int range)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                const T v = static_cast<T>(static_cast<int>(rng.rand() % static_cast<uint64_t>(2 * range + 1)) - range);
+                std::memcpy(data.data() + offset + i * sizeof(T), &v, sizeof(T));
+            }
+        };
+        fill.template operator()<int16_t>(FT_WEIGHTS_OFFSET, INPUTS * HIDDEN, 32);
+        fill.template operator()<int16_t>(FT_BIASES_OFFSET, HIDDEN, 64);
+        fill.template operator()<int8_t>(L1_WEIGHTS_OFFSET, L1_OUT * 2 * HIDDEN, 127);
+        fill.template operator()<int32_t>(L1_BIASES_OFFSET, L1_OUT, 4096);
+        fill.template operator()<int8_t>(L2_WEIGHTS_OFFSET, L1_OUT, 127);
+        fill.template operator()<int32_t>(L2_BIAS_OFFSET, 1, 1024);
+
+        std::ofstream out{std::string(path), std::ios::binary};
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(out);
+    }
+} // namespace NNUE
@@ -0,0 +1,60 @@
+#pragma once
+#include "types.h"
+#include <bits/stdc++.h>
+
+struct Position;
+
+namespace NNUE
+{
+    // Архитектура: (768 -> 256) x 2 перспективы -> 32 -> 1.
+    // Признак - фигура (свой/чужой цвет, тип) на поле, поле отражается по вертикали для чёрных
+    constexpr size_t INPUTS = 2 * 6 * static_cast<size_t>(Map::CNT_SQUARES);
+    constexpr size_t HIDDEN = 256;
+    constexpr size_t L1_OUT = 32;
+
+    constexpr int ACTIVATION_MAX = 127; // clipped ReLU, вход следующего слоя помещается в int8
+    constexpr int L1_SHIFT = 6;         // масштаб весов первого плотного слоя
+    constexpr int OUTPUT_SCALE = 16;    // выход сети в сантипешках после деления
+    constexpr int MAX_SCORE = 20000;    // оценка не должна попадать в диапазон матов
+
+    constexpr std::string_view DEFAULT_FILE = "dumpfish.nnue";
+
+    // Выход первого слоя для обеих перспектив, индекс - Color
+    struct alignas(64) Accumulator
+    {
+        std::array<std::array<int16_t, HIDDEN>, 2> values;
+    };
+
+    // Фигуры, снятые и поставленные одним ходом: не больше двух каждого вида (рокировка, взятие с превращением)
+    struct DirtyPieces
+    {
+        struct Entry
+        {
+            uint16_t piece_code, sq;
+        };
+        std::array<Entry, 2> removed, added;
+        uint8_t cnt_removed = 0, cnt_added = 0;
+
+        void remove(uint16_t piece_code, uint16_t sq) { removed[cnt_removed++] = {piece_code, sq}; }
+        void add(uint16_t piece_code, uint16_t sq) { added[cnt_added++] = {piece_code, sq}; }
+    };
+
+    // Отображает файл сети в память; при ошибке прежняя сеть сохраняется и возвращается false
+    bool load(std::string_view path);
+    bool is_loaded();
+    const std::string &loaded_file();
+
+    // Полный пересчёт аккумулятора по расстановке
+    void refresh(const Position &pos, Accumulator &acc);
+    // acc = prev с вычтенными столбцами снятых фигур и добавленными - поставленных
+    void update(Accumulator &acc, const Accumulator &prev, const DirtyPieces &dirty);
+
+    // Оценка с точки зрения стороны, чья очередь хода, по верхнему аккумулятору позиции
+    int evaluate(const Position &pos);
+
+    // Самопроверка на позиции: верхний аккумулятор против полного пересчёта, рабочие ядра и каждое
+    // поддерживаемое процессором SIMD-ядро против скалярных. Возвращает число расхождений
+    int verify(const Position &pos);
+    // Случайная сеть в формате load() - для проверок без настоящего файла сети
+    bool write_random(std::string_view path, uint64_t seed);
+} // namespace NNUE
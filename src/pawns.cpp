@@ -0,0 +1,157 @@
+#include "pawns.hpp"
+
+namespace Pawns
+{
+    namespace
+    {
+        constexpr size_t CNT_SQUARES = static_cast<size_t>(Map::CNT_SQUARES);
+        using SquareTable = std::array<std::array<Bitboard, CNT_SQUARES>, 2>; // [цвет][поле]
+
+        constexpr PSQT::Score DOUBLED = PSQT::make_score(-10, -25);
+        constexpr PSQT::Score ISOLATED = PSQT::make_score(-6, -14);
+        constexpr PSQT::Score BACKWARD = PSQT::make_score(-8, -12);
+        // Проходная по относительной горизонтали, поверх бонуса из таблиц фигур
+        constexpr std::array<PSQT::Score, 8> PASSED = {
+            PSQT::make_score(0, 0),   PSQT::make_score(2, 8),   PSQT::make_score(5, 12),  PSQT::make_score(10, 22),
+            PSQT::make_score(25, 45), PSQT::make_score(50, 90), PSQT::make_score(80, 140), PSQT::make_score(0, 0),
+        };
+        // Пешка щита на соседней с королём горизонтали, через одну и её отсутствие; в эндшпиле щит не важен
+        constexpr PSQT::Score SHIELD_CLOSE = PSQT::make_score(12, 0);
+        constexpr PSQT::Score SHIELD_FAR = PSQT::make_score(6, 0);
+        constexpr PSQT::Score SHIELD_MISSING = PSQT::make_score(-12, 0);
+
+        constexpr Bitboard file_bb(int file) { return BB::FILE_A << file; }
+
+        constexpr Bitboard adjacent_files_bb(int file)
+        {
+            return (file > 0 ? file_bb(file - 1) : 0) | (file < 7 ? file_bb(file + 1) : 0);
+        }
+
+        // Горизонтали строго впереди поля с точки зрения цвета
+        constexpr SquareTable FORWARD_RANKS = []
+        {
+            SquareTable t{};
+            for (size_t sq = 0; sq < CNT_SQUARES; ++sq)
+            {
+                for (size_t other = 0; other < CNT_SQUARES; ++other)
+                {
+                    if ((other >> 3) > (sq >> 3)) t[static_cast<size_t>(Color::WHITE)][sq] |= Bitboard{1} << other;
+                    if ((other >> 3) < (sq >> 3)) t[static_cast<size_t>(Color::BLACK)][sq] |= Bitboard{1} << other;
+                }
+            }
+            return t;
+        }();
+
+        constexpr Bitboard forward_file(Color c, uint16_t sq)
+        {
+            return FORWARD_RANKS[static_cast<size_t>(c)][sq] & file_bb(sq & 7);
+        }
+
+        // Поля, где чужая пешка мешает пешке на sq стать проходной
+        constexpr Bitboard passed_span(Color c, uint16_t sq)
+        {
+            return FORWARD_RANKS[static_cast<size_t>(c)][sq] & (file_bb(sq & 7) | adjacent_files_bb(sq & 7));
+        }
+
+        constexpr int relative_rank(Color c, uint16_t sq)
+        {
+            return c == Color::WHITE ? sq >> 3 : 7 - (sq >> 3);
+        }
+
+        PSQT::Score evaluate_structure(const Position &pos, Color us)
+        {
+            const Color them = us == Color::WHITE ? Color::BLACK : Color::WHITE;
+            const Bitboard our_pawns = pos.pieces(us, PieceType::PAWN);
+            const Bitboard their_pawns = pos.pieces(them, PieceType::PAWN);
+            const int push = us == Color::WHITE ? static_cast<int>(Map::WIDTH) : -static_cast<int>(Map::WIDTH);
+
+            PSQT::Score score = 0;
+            for (Bitboard b = our_pawns; b;)
+            {
+                const uint16_t sq = BB::pop_lsb(b);
+                const Bitboard neighbours = our_pawns & adjacent_files_bb(sq & 7);
+                const bool doubled = our_pawns & forward_file(us, sq);
+
+                if (doubled)
+                {
+                    score += DOUBLED;
+                }
+                if (!neighbours)
+                {
+                    score += ISOLATED;
+                }
+                // Все соседи ушли вперёд, а поле перед пешкой бьёт чужая пешка - догнать их она не может
+                else if (!(neighbours & ~FORWARD_RANKS[static_cast<size_t>(us)][sq]) &&
+                         (BB::pawn_attacks(us, static_cast<uint16_t>(sq + push)) & their_pawns))
+                {
+                    score += BACKWARD;
+                }
+                if (!doubled && !(their_pawns & passed_span(us, sq)))
+                {
+                    score += PASSED[relative_rank(us, sq)];
+                }
+            }
+            return score;
+        }
+
+        PSQT::Score evaluate_shield(const Position &pos, Color us, uint16_t king_sq)
+        {
+            const Bitboard our_pawns = pos.pieces(us, PieceType::PAWN) & FORWARD_RANKS[static_cast<size_t>(us)][king_sq];
+            const int king_file = king_sq & 7;
+
+            PSQT::Score score = 0;
+            for (int file = std::max(king_file - 1, 0); file <= std::min(king_file + 1, 7); ++file)
+            {
+                const Bitboard shield = our_pawns & file_bb(file);
+                if (!shield)
+                {
+                    score += SHIELD_MISSING;
+                    continue;
+                }
+                // Ближайшая к королю пешка на вертикали
+                const uint16_t sq = us == Color::WHITE ? BB::lsb(shield) : static_cast<uint16_t>(63 - std::countl_zero(shield));
+                const int distance = relative_rank(us, sq) - relative_rank(us, king_sq);
+                score += distance == 1 ? SHIELD_CLOSE : distance == 2 ? SHIELD_FAR : 0;
+            }
+            return score;
+        }
+    } // namespace
+
+    Entry &Table::probe(const Position &pos)
+    {
+        Entry &entry = entries[pos.pawn_key & (TABLE_SIZE - 1)];
+        ++stats.probes;
+        if (entry.key == pos.pawn_key)
+        {
+            ++stats.hits;
+            return entry;
+        }
+
+        entry.key = pos.pawn_key;
+        entry.score = evaluate_structure(pos, Color::WHITE) - evaluate_structure(pos, Color::BLACK);
+        entry.shield_king_sq.fill(static_cast<uint16_t>(Map::CNT_SQUARES));
+        return entry;
+    }
+
+    void Table::clear()
+    {
+        // Ключ 0 - позиция без пешек, её оценка структуры и так нулевая
+        std::fill(entries.begin(), entries.end(), Entry{0, 0, {static_cast<uint16_t>(Map::CNT_SQUARES), static_cast<uint16_t>(Map::CNT_SQUARES)}, {0, 0}});
+        stats = {};
+    }
+
+    PSQT::Score evaluate(const Position &pos, Table &table)
+    {
+        Entry &entry = table.probe(pos);
+        for (Color c : {Color::WHITE, Color::BLACK})
+        {
+            const size_t idx = static_cast<size_t>(c);
+            if (entry.shield_king_sq[idx] != pos.king_sq[idx])
+            {
+                entry.shield_king_sq[idx] = pos.king_sq[idx];
+                entry.shield[idx] = evaluate_shield(pos, c, pos.king_sq[idx]);
+            }
+        }
+        return entry.score + entry.shield[static_cast<size_t>(Color::WHITE)] - entry.shield[static_cast<size_t>(Color::BLACK)];
+    }
+} // namespace Pawns
@@ -0,0 +1,44 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include <bits/stdc++.h>
+
+namespace Pawns
+{
+    constexpr size_t TABLE_SIZE = 1 << 14; // записей на поток, структура пешек меняется редко
+
+    // Оценка структуры пешек для одного pawn_key, с точки зрения белых.
+    // Щит зависит ещё и от поля короля, поэтому кэшируется отдельно для поля, на котором его считали
+    struct Entry
+    {
+        uint64_t key;
+        PSQT::Score score;
+        std::array<uint16_t, 2> shield_king_sq;
+        std::array<PSQT::Score, 2> shield;
+    };
+
+    struct Stats
+    {
+        uint64_t probes = 0;
+        uint64_t hits = 0;
+    };
+
+    // Таблица одного потока поиска: без синхронизации, запись просто перезаписывается
+    class Table
+    {
+    public:
+        Table() : entries(TABLE_SIZE) { clear(); }
+
+        // Запись для структуры пешек pos; при промахе пересчитывается на месте
+        Entry &probe(const Position &pos);
+        void clear();
+
+        Stats stats;
+
+    private:
+        std::vector<Entry> entries;
+    };
+
+    // Структура пешек и щиты перед королями, с точки зрения белых
+    PSQT::Score evaluate(const Position &pos, Table &table);
+} // namespace Pawns
@@ -0,0 +1,267 @@
+#include "perft.hpp"
+#include "memory.hpp"
+
+namespace Perft
+{
+    Cache g_cache;
+
+    namespace
+    {
+        // Поддерево perft: ходы от корня до точки разбиения
+        struct Task
+        {
+            std::array<Move, MAX_SPLIT_DEPTH> path;
+            int length;
+            size_t root_index;
+            uint64_t nodes;
+        };
+
+        // Очередь потока: владелец берёт задачи с конца, остальные крадут с начала.
+        // Задачи крупные, поэтому мьютекс на очередь почти не конкурирует
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void collect_tasks(Position &pos, int split, std::array<Move, MAX_SPLIT_DEPTH> &path, int ply,
+                           size_t root_index, std::vector<Task> &tasks)
+        {
+            if (ply == split)
+            {
+                tasks.push_back({path, ply, root_index, 0});
+                return;
+            }
+
+            MoveGen::MoveList move_list;
+            MoveGen::generate_moves(pos, move_list);
+            for (const MoveGen::MoveInfo &mi : move_list)
+            {
+                path[ply] = mi.move;
+                pos.do_move(mi.move);
+                collect_tasks(pos, split, path, ply + 1, root_index, tasks);
+                pos.undo_move();
+            }
+        }
+
+        bool pop_task(std::vector<WorkQueue> &queues, size_t self, size_t &task)
+        {
+            {
+                std::lock_guard lock(queues[self].mutex);
+                if (!queues[self].tasks.empty())
+                {
+                    task = queues[self].tasks.back();
+                    queues[self].tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues.size(); ++i)
+            {
+                WorkQueue &victim = queues[(self + i) % queues.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+    } // namespace
+
+    void Cache::resize(size_t mb)
+    {
+        buckets.reset();
+        bucket_count = mb * 1024 * 1024 / sizeof(Bucket);
+        if (bucket_count != 0)
+        {
+            buckets = std::make_unique<Bucket[]>(bucket_count);
+        }
+        clear();
+    }
+
+    void Cache::clear()
+    {
+        for (size_t i = 0; i < bucket_count; ++i)
+        {
+            for (Slot &slot : buckets[i].slots)
+            {
+                slot.key_xor_data.store(0, std::memory_order_relaxed);
+                slot.data.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Cache::probe(uint64_t key, int depth, uint64_t &nodes) const
+    {
+        key = hashed_key(key, depth);
+        for (const Slot &slot : bucket_for(key).slots)
+        {
+            const uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if ((slot.key_xor_data.load(std::memory_order_relaxed) ^ data) == key and
+                static_cast<int>(data & 0xFF) == depth)
+            {
+                nodes = data >> 8;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Cache::store(uint64_t key, int depth, uint64_t nodes)
+    {
+        key = hashed_key(key, depth);
+        Bucket &bucket = bucket_for(key);
+
+        // Вытесняем самое мелкое поддерево: глубокие дороже пересчитывать
+        Slot *replace = &bucket.slots[0];
+        int worst = std::numeric_limits<int>::max();
+        for (Slot &slot : bucket.slots)
+        {
+            const int slot_depth = static_cast<int>(slot.data.load(std::memory_order_relaxed) & 0xFF);
+            if (slot_depth < worst)
+            {
+                worst = slot_depth;
+                replace = &slot;
+            }
+        }
+
+        const uint64_t data = nodes << 8 | static_cast<uint64_t>(depth);
+        replace->data.store(data, std::memory_order_relaxed);
+        replace->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    template <MakeMode M>
+    uint64_t perft(PositionStack<M> &stack, int depth, MoveGen::MoveList *ss, Stats &stats)
+    {
+        const Position &pos = stack.current();
+        if (depth == 0)
+        {
+            return 1;
+        }
+
+        // Глубина 1 считается дешевле, чем проба кэша, поэтому кэшируем только с двух полуходов
+        uint64_t nodes = 0;
+        const bool use_cache = depth > 1 and g_cache.enabled();
+        if (use_cache)
+        {
+            ++stats.probes;
+            if (g_cache.probe(pos.key, depth, nodes))
+            {
+                ++stats.hits;
+                return nodes;
+            }
+        }
+
+        MoveGen::MoveList &move_list = *ss;
+        move_list.clear();
+        MoveGen::generate_moves(pos, move_list);
+
+        // Генератор легальный - на последнем уровне ходы можно не делать
+        if (depth == 1)
+        {
+            return move_list.size();
+        }
+
+        for (const MoveGen::MoveInfo &mi : move_list)
+        {
+            stack.make(mi.move);
+            nodes += perft(stack, depth - 1, ss + 1, stats);
+            stack.unmake();
+        }
+
+        if (use_cache)
+        {
+            g_cache.store(pos.key, depth, nodes);
+        }
+        return nodes;
+    }
+
+    template uint64_t perft(PositionStack<MakeMode::MAKE_UNMAKE> &, int, MoveGen::MoveList *, Stats &);
+    template uint64_t perft(PositionStack<MakeMode::COPY_MAKE> &, int, MoveGen::MoveList *, Stats &);
+
+    std::vector<RootMoveCount> parallel_perft(const Position &root, int depth, int threads, int split, Stats &stats)
+    {
+        std::vector<RootMoveCount> result;
+        if (depth <= 0)
+        {
+            return result;
+        }
+        split = std::clamp(split, 1, std::min(depth, MAX_SPLIT_DEPTH));
+        threads = std::max(threads, 1);
+
+        Position pos = root;
+        MoveGen::MoveList root_moves;
+        MoveGen::generate_moves(pos, root_moves);
+
+        std::vector<Task> tasks;
+        std::array<Move, MAX_SPLIT_DEPTH> path;
+        path.fill(Move::none());
+        for (const MoveGen::MoveInfo &mi : root_moves)
+        {
+            result.push_back({mi.move, 0});
+            path[0] = mi.move;
+            pos.do_move(mi.move);
+            collect_tasks(pos, split, path, 1, result.size() - 1, tasks);
+            pos.undo_move();
+        }
+
+        // Раздаём задачи по кругу: соседние задачи - поддеревья одного хода, так нагрузка ровнее
+        std::vector<WorkQueue> queues(static_cast<size_t>(threads));
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            queues[i % queues.size()].tasks.push_back(i);
+        }
+
+        std::vector<Stats> worker_stats(queues.size());
+        {
+            std::vector<std::jthread> workers;
+            for (size_t id = 0; id < queues.size(); ++id)
+            {
+                workers.emplace_back([&, id]
+                {
+                    Position worker_pos = root;
+                    auto stack = std::make_unique<MoveGen::MoveStack>();
+                    Stats local; // счётчики в своей кэш-линии, общие пишутся один раз в конце
+                    size_t index;
+                    while (pop_task(queues, id, index))
+                    {
+                        Task &task = tasks[index];
+#ifdef DEBUG
+                        const uint64_t allocations_before = Memory::t_allocations;
+#endif
+                        for (int i = 0; i < task.length; ++i)
+                        {
+                            worker_pos.do_move(task.path[i]);
+                        }
+                        task.nodes = perft(worker_pos, depth - task.length, stack->data(), local);
+                        for (int i = 0; i < task.length; ++i)
+                        {
+                            worker_pos.undo_move();
+                        }
+#ifdef DEBUG
+                        local.allocations += Memory::t_allocations - allocations_before;
+#endif
+                    }
+                    worker_stats[id] = local;
+                });
+            }
+        }
+
+        // Суммируем в порядке задач, а не завершения потоков: результат не зависит от расписания
+        for (const Task &task : tasks)
+        {
+            result[task.root_index].nodes += task.nodes;
+        }
+        for (const Stats &ws : worker_stats)
+        {
+            stats.probes += ws.probes;
+            stats.hits += ws.hits;
+#ifdef DEBUG
+            stats.allocations += ws.allocations;
+#endif
+        }
+        return result;
+    }
+} // namespace Perft
@@ -0,0 +1,90 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include "movegen.hpp"
+#include <bits/stdc++.h>
+
+namespace Perft
+{
+    // Кэш поддеревьев perft: (ключ позиции, глубина) -> число листьев.
+    // Устроен как TT: запись хранит key ^ data, поэтому годится и для параллельного обхода без блокировок
+    class Cache
+    {
+    public:
+        // Размер в мегабайтах, 0 - кэш выключен
+        void resize(size_t mb);
+        void clear();
+        bool enabled() const { return bucket_count != 0; }
+
+        bool probe(uint64_t key, int depth, uint64_t &nodes) const;
+        void store(uint64_t key, int depth, uint64_t nodes);
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> key_xor_data;
+            std::atomic<uint64_t> data; // nodes << 8 | depth
+        };
+
+        static constexpr size_t SLOTS_PER_BUCKET = 4;
+
+        struct alignas(64) Bucket
+        {
+            std::array<Slot, SLOTS_PER_BUCKET> slots;
+        };
+        static_assert(sizeof(Bucket) == 64);
+
+        // Одна позиция на разных глубинах - разные записи: подмешиваем глубину в ключ
+        static constexpr uint64_t hashed_key(uint64_t key, int depth)
+        {
+            return key ^ (static_cast<uint64_t>(depth) * 0x9E3779B97F4A7C15ULL);
+        }
+
+        const Bucket &bucket_for(uint64_t key) const
+        {
+            return buckets[static_cast<size_t>((static_cast<unsigned __int128>(key) * bucket_count) >> 64)];
+        }
+        Bucket &bucket_for(uint64_t key)
+        {
+            return const_cast<Bucket &>(std::as_const(*this).bucket_for(key));
+        }
+
+        std::unique_ptr<Bucket[]> buckets;
+        size_t bucket_count = 0;
+    };
+
+    extern Cache g_cache;
+
+    struct Stats
+    {
+        uint64_t probes = 0;
+        uint64_t hits = 0;
+#ifdef DEBUG
+        uint64_t allocations = 0; // обращения к куче во время обхода, проверка ждёт 0
+#endif
+    };
+
+    // Число листьев на глубине depth. ss - стек списков ходов длиной не меньше depth
+    template <MakeMode M>
+    uint64_t perft(PositionStack<M> &stack, int depth, MoveGen::MoveList *ss, Stats &stats);
+
+    inline uint64_t perft(Position &pos, int depth, MoveGen::MoveList *ss, Stats &stats)
+    {
+        PositionStack<MakeMode::MAKE_UNMAKE> stack(pos);
+        return perft(stack, depth, ss, stats);
+    }
+
+    // Наибольшая глубина разбиения на задачи: дальше задач слишком много и они слишком мелкие
+    constexpr int MAX_SPLIT_DEPTH = 6;
+
+    struct RootMoveCount
+    {
+        Move move;
+        uint64_t nodes;
+    };
+
+    // Параллельный perft с разбивкой по ходам корня (divide). Дерево режется на задачи на глубине
+    // split полуходов, задачи раздаются потокам с кражей работы, у каждого потока своя копия позиции.
+    // Сумма по корневым ходам совпадает с последовательным perft
+    std::vector<RootMoveCount> parallel_perft(const Position &root, int depth, int threads, int split, Stats &stats);
+} // namespace Perft
@@ -1,42 +1,104 @@
 #pragma once
 #include "position.hpp"
 
+namespace Zobrist
+{
+    std::array<std::array<uint64_t, static_cast<size_t>(Map::CNT_SQUARES)>, 16> psq;
+    std::array<uint64_t, 16> castling;
+    std::array<uint64_t, static_cast<size_t>(Map::WIDTH)> enpassant;
+    uint64_t side;
+
+    void init()
+    {
+        BB::PRNG rng{0x5EED2025};
+
+        for (auto &piece_keys : psq)
+        {
+            for (uint64_t &k : piece_keys) k = rng.rand();
+        }
+        for (uint64_t &k : castling) k = rng.rand();
+        for (uint64_t &k : enpassant) k = rng.rand();
+        side = rng.rand();
+
+        // Пустое поле не меняет ключ
+        psq[static_cast<size_t>(PieceType::EMPTY)].fill(0);
+    }
+} // namespace Zobrist
+
+
 
 Position::Position(std::array<uint16_t, static_cast<uint16_t>(Map::CNT_SQUARES)> &board,
             uint16_t features, uint16_t rule50cnt, uint16_t enpassant_target_square)
-    : features{features}, rule50cnt{rule50cnt}, enpassant_target_square{enpassant_target_square}, end_pieces_list{0}, moves(), state_history(), king_sq{static_cast<uint16_t>(Map::CNT_SQUARES), static_cast<uint16_t>(Map::CNT_SQUARES)}
+    : PositionCore(features, rule50cnt, enpassant_target_square)
 {
-    this->board.fill(static_cast<uint16_t>(Map::CNT_SQUARES));
-    pieces_list.fill(Piece::none());
-
     for (std::size_t i = 0; i < board.size(); ++i)
     {
         if (board[i] != static_cast<uint16_t>(PieceType::EMPTY))
         {
-            pieces_list[end_pieces_list] = {board[i],
-                                            static_cast<uint16_t>(i)};
+            pieces_list[end_pieces_list] = {static_cast<uint8_t>(board[i]),
+                                            static_cast<uint8_t>(i)};
             this->board[i] = end_pieces_list++;
+            toggle_piece_bb(board[i], static_cast<uint16_t>(i));
             if(FEN::get_piece_type(board[i]) == PieceType::KING){
                 king_sq[static_cast<size_t>(FEN::get_piece_color(board[i]))] = static_cast<uint16_t>(i);
             }
         }
     }
+    compute_attacks();
+    key = compute_key();
+    pawn_key = compute_pawn_key();
+    psq = compute_psq();
+    refresh_accumulators();
 }
 
-Position::Position(uint16_t features, uint16_t rule50cnt)
-    : features(features), rule50cnt(rule50cnt), enpassant_target_square(static_cast<uint16_t>(Map::CNT_SQUARES)), end_pieces_list(0), moves(), state_history(), king_sq{static_cast<uint16_t>(Map::CNT_SQUARES), static_cast<uint16_t>(Map::CNT_SQUARES)}
+PositionCore::PositionCore(uint16_t features, uint16_t rule50cnt, uint16_t enpassant_target_square)
+    : by_type{}, by_color{}, occupied{0}, key{0}, pawn_key{0}, psq{0}, rule50cnt{rule50cnt}, features{static_cast<uint8_t>(features)}, enpassant_target_square{static_cast<uint8_t>(enpassant_target_square)}, king_sq{static_cast<uint8_t>(Map::CNT_SQUARES), static_cast<uint8_t>(Map::CNT_SQUARES)}, end_pieces_list{0}
 {
     pieces_list.fill(Piece::none());
-    board.fill(static_cast<uint16_t>(Map::CNT_SQUARES));
+    board.fill(static_cast<uint8_t>(Map::CNT_SQUARES));
+    attacks_from.fill(0);
+}
+
+Position::Position(uint16_t features, uint16_t rule50cnt)
+    : PositionCore(features, rule50cnt, static_cast<uint16_t>(Map::CNT_SQUARES))
+{
+}
+
+Position::Position(const Position &other) : PositionCore(other), states(other.states)
+{
+    if (!other.accumulators.empty())
+    {
+        accumulators.reserve(StateStack::CAPACITY);
+    }
+    accumulators = other.accumulators;
+}
+
+Position &Position::operator=(const Position &other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    static_cast<PositionCore &>(*this) = other;
+    states = other.states;
+    if (!other.accumulators.empty())
+    {
+        accumulators.reserve(StateStack::CAPACITY);
+    }
+    accumulators = other.accumulators;
+    return *this;
 }
 
 void Position::set_from_fen(std::string_view fen_view)
 {
-    moves.clear();
-    state_history.clear();
+    states.reset();
 
     pieces_list.fill(Piece::none());
     board.fill(static_cast<uint16_t>(Map::CNT_SQUARES));
+    by_type.fill(0);
+    by_color.fill(0);
+    occupied = 0;
+    key = 0;
     features = 0;
     rule50cnt = 0;
 
@@ -107,8 +169,9 @@ void Position::set_from_fen(std::string_view fen_view)
                 king_sq[static_cast<size_t>(FEN::get_piece_color(piece))] = position;
             }
 
-            pieces_list[end_pieces_list] = {piece, position};
+            pieces_list[end_pieces_list] = {static_cast<uint8_t>(piece), static_cast<uint8_t>(position)};
             board[position] = end_pieces_list++;
+            toggle_piece_bb(piece, position);
             file++;
         }
     }
@@ -116,6 +179,7 @@ void Position::set_from_fen(std::string_view fen_view)
     {
         throw std::runtime_error("Invalid FEN string: board description incomplete or overflown.");
     }
+    compute_attacks();
 
     std::string_view side_part = read_part();
     if (side_part == "w")
@@ -216,11 +280,50 @@ void Position::set_from_fen(std::string_view fen_view)
             throw std::runtime_error("Invalid FEN string: unexpected characters after fullmove number.");
         }
     }
+
+    key = compute_key();
+    pawn_key = compute_pawn_key();
+    psq = compute_psq();
+    refresh_accumulators();
 }
 
-void  Position::do_move(Move m)
+void Position::do_move(Move m)
+{
+    const NNUE::DirtyPieces dirty = make_move(m);
+    if (!accumulators.empty())
+    {
+        accumulators.emplace_back();
+        NNUE::update(accumulators.back(), accumulators[accumulators.size() - 2], dirty);
+#ifdef DEBUG
+        NNUE::Accumulator full;
+        NNUE::refresh(*this, full);
+        assert(full.values == accumulators.back().values);
+#endif
+    }
+}
+
+void Position::do_move(Move m, Position &out) const
+{
+    static_cast<PositionCore &>(out) = *this;
+    out.states.reset();
+    const NNUE::DirtyPieces dirty = out.make_move(m);
+    if (accumulators.empty())
+    {
+        out.accumulators.clear();
+    }
+    else
+    {
+        out.accumulators.resize(1);
+        NNUE::update(out.accumulators[0], accumulators.back(), dirty);
+    }
+}
+
+NNUE::DirtyPieces Position::make_move(Move m)
 {
     uint16_t side_to_move_bit = (features >> static_cast<uint16_t>(Map::LOG_BIT_SIDE_TO_MOVE)) & 0x1;
+    const uint64_t prev_key = key;
+    const uint64_t prev_pawn_key = pawn_key;
+    const PSQT::Score prev_psq = psq;
 
     const uint16_t source_sq = m.source();
     const uint16_t dest_sq = m.dest();
@@ -237,12 +340,21 @@ void  Position::do_move(Move m)
     PieceType captured_piece_type = FEN::get_piece_type(captured_piece_code);
     // if captured_piece_list_idx == Map::CNT_SQUARES it's still in the range of array
 
+    Bitboard changed = BB::square_bb(source_sq) | BB::square_bb(dest_sq); // поля, где сменилась занятость
+
     const MoveType m_type = m.type();
     bool is_enpassant{m_type == MoveType::EN_PASSANT};
     bool is_captured{FEN::get_piece_type(captured_piece_code) != PieceType::EMPTY};
     bool is_pawn_move{moved_piece_type == PieceType::PAWN};
     bool is_pawn_long_move{is_pawn_move and ((source_sq > dest_sq ? source_sq - dest_sq : dest_sq - source_sq) == 2 * static_cast<uint16_t>(Map::WIDTH))};
 
+    NNUE::DirtyPieces dirty;
+
+    toggle_piece_bb(moved_piece_code, source_sq);
+    remove_psq(moved_piece_code, source_sq);
+    dirty.remove(moved_piece_code, source_sq);
+    toggle_pawn_key(moved_piece_code, source_sq);
+
     if (moved_piece_type == PieceType::KING)
     {
         king_sq[side_to_move_bit] = dest_sq;
@@ -254,6 +366,7 @@ void  Position::do_move(Move m)
                             (side_to_move_bit == static_cast<uint16_t>(Color::WHITE) ? -static_cast<int>(Map::WIDTH) : static_cast<int>(Map::WIDTH));
         captured_piece_list_idx = board[captured_piece_sq];
         captured_piece_code = pieces_list[captured_piece_list_idx].type;
+        changed |= BB::square_bb(captured_piece_sq);
         
         // after that remove as it's normal move
         is_captured = true;
@@ -275,6 +388,13 @@ void  Position::do_move(Move m)
         uint16_t rook_to_sq = (is_short) ? dest_sq - 1 : dest_sq + 1;
 
         uint16_t rook_list_idx = board[rook_from_sq];
+        changed |= BB::square_bb(rook_from_sq) | BB::square_bb(rook_to_sq);
+        toggle_piece_bb(pieces_list[rook_list_idx].type, rook_from_sq);
+        toggle_piece_bb(pieces_list[rook_list_idx].type, rook_to_sq);
+        remove_psq(pieces_list[rook_list_idx].type, rook_from_sq);
+        add_psq(pieces_list[rook_list_idx].type, rook_to_sq);
+        dirty.remove(pieces_list[rook_list_idx].type, rook_from_sq);
+        dirty.add(pieces_list[rook_list_idx].type, rook_to_sq);
         pieces_list[rook_list_idx].position = rook_to_sq;
         board[rook_to_sq] = rook_list_idx;
         board[rook_from_sq] = static_cast<uint16_t>(Map::CNT_SQUARES);
@@ -282,6 +402,10 @@ void  Position::do_move(Move m)
 
     if (is_captured or is_enpassant)
     { // remove captured piece from the board
+        toggle_piece_bb(captured_piece_code, captured_piece_sq);
+        remove_psq(captured_piece_code, captured_piece_sq); // при взятии на проходе - поле пешки, а не dest_sq
+        dirty.remove(captured_piece_code, captured_piece_sq);
+        toggle_pawn_key(captured_piece_code, captured_piece_sq);
         --end_pieces_list;
         board[pieces_list[end_pieces_list].position] = captured_piece_list_idx; // set new idx on the board for last piece in the list
         pieces_list[captured_piece_list_idx] = pieces_list[end_pieces_list];    // move last piece info into new idx in the list
@@ -296,9 +420,14 @@ void  Position::do_move(Move m)
     board[source_sq] = static_cast<uint16_t>(Map::CNT_SQUARES);
     board[dest_sq] = moved_piece_list_idx;
     pieces_list[moved_piece_list_idx].position = dest_sq;
+    toggle_piece_bb(moved_piece_code, dest_sq); // после превращения - уже новая фигура
+    add_psq(moved_piece_code, dest_sq);
+    dirty.add(moved_piece_code, dest_sq);
+    toggle_pawn_key(moved_piece_code, dest_sq); // превращённая пешка в ключ не возвращается
+    update_attacks(changed);
 
-    state_history.emplace_back(features, rule50cnt, enpassant_target_square, captured_piece_code, captured_piece_sq);
-    moves.emplace_back(std::move(m));
+    const StateInfo &prev = states.push() = StateInfo(features, rule50cnt, enpassant_target_square, captured_piece_code, captured_piece_sq,
+                                                      prev_key, prev_pawn_key, prev_psq, m);
 
     uint16_t new_enpassant_target = static_cast<int>(dest_sq) +
                                     (side_to_move_bit == static_cast<uint16_t>(Color::WHITE) ? -static_cast<int>(Map::WIDTH) : static_cast<int>(Map::WIDTH));
@@ -324,11 +453,42 @@ void  Position::do_move(Move m)
 
     features ^= static_cast<uint16_t>(Map::BIT_SIDE_TO_MOVE);
     rule50cnt = (is_captured or is_pawn_move) ? 0 : rule50cnt + 1;
+
+    // Фигуры уже учтены в toggle_piece_bb, остались права рокировки, взятие на проходе и очередь хода
+    key ^= Zobrist::castling[Zobrist::castling_index(prev.features)] ^ Zobrist::castling[Zobrist::castling_index(features)];
+    if (prev.enpassant_target_square != static_cast<uint16_t>(Map::CNT_SQUARES))
+    {
+        key ^= Zobrist::enpassant[prev.enpassant_target_square & 0x7];
+    }
+    if (enpassant_target_square != static_cast<uint16_t>(Map::CNT_SQUARES))
+    {
+        key ^= Zobrist::enpassant[enpassant_target_square & 0x7];
+    }
+    key ^= Zobrist::side;
+
+#ifdef DEBUG
+    assert(key == compute_key());
+    assert(pawn_key == compute_pawn_key());
+    assert(psq == compute_psq());
+#endif
+    return dirty;
+}
+
+void Position::trim_history()
+{
+    // Повторение ищется не дальше последнего необратимого хода, а после 100 обратимых полуходов и так ничья
+    const size_t keep = std::min<size_t>(rule50cnt, 100);
+    const size_t dropped = states.ply() - std::min(keep, states.ply());
+    states.keep_last(keep);
+    if (!accumulators.empty())
+    {
+        accumulators.erase(accumulators.begin(), accumulators.begin() + static_cast<std::ptrdiff_t>(dropped));
+    }
 }
 
 void Position::undo_move()
 {
-    StateInfo &st = state_history.back();
+    const StateInfo &st = *states.current();
     features = st.features;
     rule50cnt = st.rule50cnt;
     enpassant_target_square = st.enpassant_target_square;
@@ -336,13 +496,16 @@ void Position::undo_move()
     uint16_t captured_piece_code = st.captured_piece_code; // Что взяли
     uint16_t captured_piece_sq = st.captured_piece_sq;     // Где оно стояло
 
-    Move &m = moves.back();
+    const Move m = st.move;
     const uint16_t source_sq = m.source();
     const uint16_t dest_sq = m.dest();
     const MoveType m_type = m.type();
     uint16_t side_to_move_bit = (features >> static_cast<uint16_t>(Map::LOG_BIT_SIDE_TO_MOVE)) & 0x1;
 
+    Bitboard changed = BB::square_bb(source_sq) | BB::square_bb(dest_sq);
+
     uint16_t moved_piece_list_idx = board[dest_sq];           // Находим индекс фигуры, которая сделала ход (она сейчас на dest_sq)
+    toggle_piece_bb(pieces_list[moved_piece_list_idx].type, dest_sq);
     board[source_sq] = moved_piece_list_idx;                  // Ставим фигуру обратно на source_sq
     board[dest_sq] = static_cast<uint16_t>(Map::CNT_SQUARES); // Очищаем dest_sq
     pieces_list[moved_piece_list_idx].position = source_sq;   // Обновляем позицию в списке
@@ -353,6 +516,7 @@ void Position::undo_move()
         // Возвращаем тип пешки
         pieces_list[moved_piece_list_idx].type = static_cast<uint16_t>(PieceType::PAWN) | (side_to_move_bit << static_cast<uint16_t>(Color::LOG_BIT_COLOR));
     }
+    toggle_piece_bb(pieces_list[moved_piece_list_idx].type, source_sq);
 
     // 4. Отменяем рокировку (если была)
     if (m_type == MoveType::CASTLING)
@@ -364,6 +528,9 @@ void Position::undo_move()
         uint16_t rook_original_sq = (is_short) ? dest_sq + 1 : dest_sq - 2;
 
         uint16_t rook_list_idx = board[rook_current_sq];                  // Находим индекс ладьи
+        changed |= BB::square_bb(rook_current_sq) | BB::square_bb(rook_original_sq);
+        toggle_piece_bb(pieces_list[rook_list_idx].type, rook_current_sq);
+        toggle_piece_bb(pieces_list[rook_list_idx].type, rook_original_sq);
         pieces_list[rook_list_idx].position = rook_original_sq;           // Возвращаем позицию ладьи
         board[rook_original_sq] = rook_list_idx;                          // Ставим ладью на доску
         board[rook_current_sq] = static_cast<uint16_t>(Map::CNT_SQUARES); // Убираем с промежуточного поля
@@ -380,12 +547,109 @@ void Position::undo_move()
         uint16_t new_captured_list_idx = end_pieces_list++;
 
         // Помещаем взятую фигуру в конец списка
-        pieces_list[new_captured_list_idx] = {captured_piece_code, captured_piece_sq};
+        pieces_list[new_captured_list_idx] = {static_cast<uint8_t>(captured_piece_code), static_cast<uint8_t>(captured_piece_sq)};
 
         // Ставим взятую фигуру обратно на доску
         board[captured_piece_sq] = new_captured_list_idx;
+        toggle_piece_bb(captured_piece_code, captured_piece_sq);
+        changed |= BB::square_bb(captured_piece_sq);
+    }
+    update_attacks(changed);
+    key = st.key; // toggle_piece_bb выше тоже менял ключ, сохранённое значение точнее и дешевле
+    pawn_key = st.pawn_key;
+    psq = st.psq;
+
+#ifdef DEBUG
+    assert(key == compute_key());
+    assert(pawn_key == compute_pawn_key());
+    assert(psq == compute_psq());
+#endif
+
+    states.pop();
+    if (!accumulators.empty())
+    {
+        accumulators.pop_back();
     }
+}
+
+uint64_t Position::compute_key() const
+{
+    uint64_t k = 0;
+    for (Bitboard b = occupied; b;)
+    {
+        uint16_t sq = BB::pop_lsb(b);
+        k ^= Zobrist::psq[piece_on(sq)][sq];
+    }
+    k ^= Zobrist::castling[Zobrist::castling_index(features)];
+    if (enpassant_target_square != static_cast<uint16_t>(Map::CNT_SQUARES))
+    {
+        k ^= Zobrist::enpassant[enpassant_target_square & 0x7];
+    }
+    if (features & static_cast<uint16_t>(Map::BIT_SIDE_TO_MOVE))
+    {
+        k ^= Zobrist::side;
+    }
+    return k;
+}
+
+uint64_t Position::compute_pawn_key() const
+{
+    uint64_t k = 0;
+    for (Bitboard b = pieces(PieceType::PAWN); b;)
+    {
+        uint16_t sq = BB::pop_lsb(b);
+        k ^= Zobrist::psq[piece_on(sq)][sq];
+    }
+    return k;
+}
 
-    moves.pop_back();
-    state_history.pop_back();
-}
\ No newline at end of file
+PSQT::Score Position::compute_psq() const
+{
+    PSQT::Score s = 0;
+    for (uint16_t i = 0; i < end_pieces_list; ++i)
+    {
+        s += PSQT::psq[pieces_list[i].type][pieces_list[i].position];
+    }
+    return s;
+}
+
+void Position::refresh_accumulators()
+{
+    accumulators.clear();
+    if (NNUE::is_loaded())
+    {
+        accumulators.reserve(StateStack::CAPACITY);
+        accumulators.emplace_back();
+        NNUE::refresh(*this, accumulators.back());
+    }
+}
+
+void Position::compute_attacks()
+{
+    for (uint16_t sq = 0; sq < static_cast<uint16_t>(Map::CNT_SQUARES); ++sq)
+    {
+        attacks_from[sq] = piece_attacks(piece_on(sq), sq, occupied);
+    }
+}
+
+void Position::update_attacks(Bitboard changed)
+{
+    // Луч меняется, только если проходит через поле со сменившейся занятостью.
+    // attacks_from ещё хранит лучи до изменения, поэтому проверка годится и для do_move, и для undo_move
+    Bitboard sliders = (pieces(PieceType::BISHOP) | pieces(PieceType::ROOK) | pieces(PieceType::QUEEN)) & ~changed;
+    while (sliders)
+    {
+        uint16_t sq = BB::pop_lsb(sliders);
+        if (attacks_from[sq] & changed)
+        {
+            attacks_from[sq] = piece_attacks(piece_on(sq), sq, occupied);
+        }
+    }
+
+    // Фигуры, пришедшие на изменившиеся поля; с опустевших полей атаки снимаются
+    while (changed)
+    {
+        uint16_t sq = BB::pop_lsb(changed);
+        attacks_from[sq] = piece_attacks(piece_on(sq), sq, occupied);
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "types.h"
+#include "bitboard.hpp"
+#include "psqt.hpp"
+#include "nnue.hpp"
 #include <bits/stdc++.h>
 
 
@@ -93,13 +96,29 @@ namespace FEN
 } // namespace FEN
 
 
+namespace Zobrist
+{
+    extern std::array<std::array<uint64_t, static_cast<size_t>(Map::CNT_SQUARES)>, 16> psq; // [код фигуры][поле]
+    extern std::array<uint64_t, 16> castling;                                             // по битам запрета рокировок из features
+    extern std::array<uint64_t, static_cast<size_t>(Map::WIDTH)> enpassant;              // по вертикали поля взятия на проходе
+    extern uint64_t side;                                                                  // ход чёрных
+
+    constexpr inline uint16_t castling_index(uint16_t features)
+    {
+        return (features >> static_cast<uint16_t>(Map::LOG_BIT_NO_CASTLE_WK)) & 0xF;
+    }
+
+    void init();
+} // namespace Zobrist
+
+
 struct Piece
 {
-    uint16_t type, position;
+    uint8_t type, position;
 
     static consteval Piece none()
     {
-        return {static_cast<uint16_t>(PieceType::EMPTY), static_cast<uint16_t>(Map::CNT_SQUARES)};
+        return {static_cast<uint8_t>(PieceType::EMPTY), static_cast<uint8_t>(Map::CNT_SQUARES)};
     }
 };
 
@@ -142,42 +161,140 @@ struct Move
 };
 
 
+// Запись стека состояний: ход, приведший в позицию, и то, что do_move не может восстановить сам, -
+// состояние до хода и взятая фигура
 struct StateInfo
 {
-    uint16_t features;
+    uint64_t key;
+    uint64_t pawn_key;
+    PSQT::Score psq;
+    Move move;
     uint16_t rule50cnt;
-    uint16_t enpassant_target_square;
-    uint16_t captured_piece_code;
-    uint16_t captured_piece_sq;
+    uint8_t features;
+    uint8_t enpassant_target_square;
+    uint8_t captured_piece_code;
+    uint8_t captured_piece_sq;
 
     StateInfo(uint16_t features = 0,
               uint16_t rule50cnt = 0,
               uint16_t enpassant_target_square = static_cast<uint16_t>(Map::CNT_SQUARES),
               uint16_t captured_piece_code = static_cast<uint16_t>(PieceType::EMPTY),
-              uint16_t captured_piece_sq = static_cast<uint16_t>(Map::CNT_SQUARES)) 
-        : features(features),
+              uint16_t captured_piece_sq = static_cast<uint16_t>(Map::CNT_SQUARES),
+              uint64_t key = 0,
+              uint64_t pawn_key = 0,
+              PSQT::Score psq = 0,
+              Move move = Move::none())
+        : key(key),
+          pawn_key(pawn_key),
+          psq(psq),
+          move(move),
           rule50cnt(rule50cnt),
-          enpassant_target_square(enpassant_target_square),
-          captured_piece_code(captured_piece_code),
-          captured_piece_sq(captured_piece_sq)
+          features(static_cast<uint8_t>(features)),
+          enpassant_target_square(static_cast<uint8_t>(enpassant_target_square)),
+          captured_piece_code(static_cast<uint8_t>(captured_piece_code)),
+          captured_piece_sq(static_cast<uint8_t>(captured_piece_sq))
     {}
 };
+static_assert(sizeof(StateInfo) == 32);
 
 
-struct Position
+// Стек записей по полуходам фиксированной ёмкости (партия + глубина перебора): do_move не проверяет ёмкость
+// и не обращается к куче. Нижняя запись - корень без хода, верхняя соответствует текущей позиции
+class StateStack
 {
-    // === ДАННЫЕ ===
-    std::array<uint16_t, static_cast<size_t>(Map::CNT_SQUARES)> board;
-    std::array<uint16_t, 2> king_sq;
-    std::array<Piece, static_cast<size_t>(Map::CNT_SQUARES) + 1> pieces_list;
-    uint16_t end_pieces_list;
+public:
+    static constexpr size_t CAPACITY = static_cast<size_t>(Map::MAX_GAME_PLY) + static_cast<size_t>(Map::MAX_PLY);
+
+    StateStack() : top(records.data()) {}
+    // Копируется только занятая часть, указатель на вершину переносится в свой массив
+    StateStack(const StateStack &other) : top(records.data()) { *this = other; }
+    StateStack &operator=(const StateStack &other)
+    {
+        std::copy_n(other.records.begin(), other.ply() + 1, records.begin());
+        top = records.data() + other.ply();
+        return *this;
+    }
+
+    void reset()
+    {
+        top = records.data();
+        *top = StateInfo{};
+    }
+    StateInfo &push()
+    {
+#ifdef DEBUG
+        assert(ply() + 1 < CAPACITY);
+#endif
+        return *++top;
+    }
+    void pop() { --top; }
+    // Оставляет только последние keep записей ходов, запись перед ними становится корнем
+    void keep_last(size_t keep)
+    {
+        keep = std::min(keep, ply());
+        std::copy(top - keep, top + 1, records.begin());
+        top = records.data() + keep;
+    }
+
+    StateInfo *current() { return top; }
+    const StateInfo *current() const { return top; }
+    // Число сделанных ходов: records[1..ply()] - записи ходов
+    size_t ply() const { return static_cast<size_t>(top - records.data()); }
+    const StateInfo &operator[](size_t i) const { return records[i]; }
 
-    uint16_t features;
+private:
+    std::array<StateInfo, CAPACITY> records;
+    StateInfo *top;
+};
+
+
+// Всё, что описывает позицию целиком, без истории ходов. Тривиально копируемо: copy-make переносит
+// позицию в дочерний слот одним присваиванием ядра.
+// Раскладка по кэш-линиям (проверяется static_assert после объявления):
+//   линии 0-1  - горячее ядро: битовые доски, ключи, оценка, счётчики и поля королей (POSITION_HOT_SIZE = 128 байт);
+//   линия 2    - board, 64 байта;
+//   линии 3-5  - pieces_list, 130 байт;
+//   линии 6-13 - attacks_from, 512 байт.
+struct PositionCore
+{
+    PositionCore(uint16_t features, uint16_t rule50cnt, uint16_t enpassant_target_square);
+
+    // Битовые доски, синхронизированы с board/pieces_list: по типу фигуры (индекс - PieceType), по цвету и общая занятость
+    alignas(64) std::array<Bitboard, static_cast<size_t>(PieceType::QUEEN) + 1> by_type;
+    std::array<Bitboard, 2> by_color;
+    Bitboard occupied;
+    uint64_t key; // Zobrist: фигуры, очередь хода, права рокировки, поле взятия на проходе
+    uint64_t pawn_key; // Zobrist только по пешкам, ключ кэша структуры пешек
+    PSQT::Score psq; // материал + таблицы фигур (mg/eg) с точки зрения белых, обновляется в do_move
     uint16_t rule50cnt;
-    uint16_t enpassant_target_square;
+    uint8_t features;
+    uint8_t enpassant_target_square;
+    std::array<uint8_t, 2> king_sq;
+    uint8_t end_pieces_list;
+
+    // Индекс фигуры в pieces_list по полю, CNT_SQUARES - пусто (pieces_list[CNT_SQUARES] всегда Piece::none())
+    alignas(64) std::array<uint8_t, static_cast<size_t>(Map::CNT_SQUARES)> board;
+    std::array<Piece, static_cast<size_t>(Map::CNT_SQUARES) + 1> pieces_list;
+
+    // Атаки фигуры, стоящей на поле (включая защиту своих), 0 для пустого поля; обновляются в do_move/undo_move
+    alignas(64) std::array<Bitboard, static_cast<size_t>(Map::CNT_SQUARES)> attacks_from;
+};
+
+constexpr size_t POSITION_HOT_SIZE = 2 * 64;
+constexpr size_t POSITION_COPY_SIZE = 14 * 64;
+static_assert(std::is_trivially_copyable_v<PositionCore>);
+static_assert(offsetof(PositionCore, board) == POSITION_HOT_SIZE, "горячее ядро Position должно занимать две кэш-линии");
+static_assert(offsetof(PositionCore, attacks_from) == 6 * 64);
+static_assert(sizeof(PositionCore) == POSITION_COPY_SIZE);
+
 
-    std::vector<StateInfo> state_history;
-    std::vector<Move> moves;
+// Ядро позиции плюс холодный хвост: стек состояний и аккумуляторы, нужные только для undo_move
+struct Position : PositionCore
+{
+    // === ДАННЫЕ ===
+    StateStack states;
+    // Стек аккумуляторов сети, верхний соответствует текущей позиции; пуст, если сеть не загружена
+    std::vector<NNUE::Accumulator> accumulators;
     
     // === СТАТИЧЕСКИЕ ХЕЛПЕРЫ ===
     static constexpr bool get_side_to_move(const Position& pos) {
@@ -195,15 +312,164 @@ struct Position
         return FEN::index_to_square(pos.enpassant_target_square);
     }
     
+    // Запись текущей позиции: последний ход и состояние до него, у корня move == Move::none()
+    const StateInfo *state() const { return states.current(); }
+
+    // === БИТОВЫЕ ДОСКИ ===
+    constexpr Bitboard pieces(PieceType pt) const { return by_type[static_cast<size_t>(pt)]; }
+    constexpr Bitboard pieces(Color c) const { return by_color[static_cast<size_t>(c)]; }
+    constexpr Bitboard pieces(Color c, PieceType pt) const { return pieces(c) & pieces(pt); }
+    constexpr uint16_t piece_on(uint16_t sq) const { return pieces_list[board[sq]].type; } // для пустого поля - PieceType::EMPTY
+
+    // Все фигуры обоих цветов, атакующие поле sq при заданной занятости
+    inline Bitboard attackers_to(uint16_t sq, Bitboard occ) const
+    {
+        return (BB::pawn_attacks(Color::BLACK, sq) & pieces(Color::WHITE, PieceType::PAWN)) |
+               (BB::pawn_attacks(Color::WHITE, sq) & pieces(Color::BLACK, PieceType::PAWN)) |
+               (BB::KnightAttacks[sq] & pieces(PieceType::KNIGHT)) |
+               (BB::rook_attacks(sq, occ) & (pieces(PieceType::ROOK) | pieces(PieceType::QUEEN))) |
+               (BB::bishop_attacks(sq, occ) & (pieces(PieceType::BISHOP) | pieces(PieceType::QUEEN))) |
+               (BB::KingAttacks[sq] & pieces(PieceType::KING));
+    }
+
+    static inline Bitboard piece_attacks(uint16_t piece_code, uint16_t sq, Bitboard occ)
+    {
+        PieceType pt = FEN::get_piece_type(piece_code);
+        return pt == PieceType::PAWN ? BB::pawn_attacks(FEN::get_piece_color(piece_code), sq) : BB::attacks(pt, sq, occ);
+    }
+
+    // Объединение атак всех фигур цвета c
+    inline Bitboard attacked_by(Color c) const
+    {
+        Bitboard attacked = 0;
+        for (Bitboard b = pieces(c); b;)
+        {
+            attacked |= attacks_from[BB::pop_lsb(b)];
+        }
+        return attacked;
+    }
+
+    // Ставит или снимает фигуру с битовых досок и ключа (xor), board/pieces_list не трогает
+    constexpr void toggle_piece_bb(uint16_t piece_code, uint16_t sq)
+    {
+        const Bitboard b = BB::square_bb(sq);
+        by_type[static_cast<size_t>(FEN::get_piece_type(piece_code))] ^= b;
+        by_color[static_cast<size_t>(FEN::get_piece_color(piece_code))] ^= b;
+        occupied ^= b;
+        key ^= Zobrist::psq[piece_code][sq];
+    }
+
+    // Меняет pawn_key, если это пешка; для остальных фигур ничего не делает
+    constexpr void toggle_pawn_key(uint16_t piece_code, uint16_t sq)
+    {
+        if (FEN::get_piece_type(piece_code) == PieceType::PAWN)
+        {
+            pawn_key ^= Zobrist::psq[piece_code][sq];
+        }
+    }
+
+    // Снимает или ставит вклад фигуры в psq; вызывается рядом с toggle_piece_bb в do_move
+    constexpr void remove_psq(uint16_t piece_code, uint16_t sq) { psq -= PSQT::psq[piece_code][sq]; }
+    constexpr void add_psq(uint16_t piece_code, uint16_t sq) { psq += PSQT::psq[piece_code][sq]; }
+
     // === ОБЪЯВЛЕНИЯ МЕТОДОВ ===
     Position(uint16_t features = 0, uint16_t rule50cnt = 0);
     Position(std::array<uint16_t, static_cast<uint16_t>(Map::CNT_SQUARES)>& board,
              uint16_t features = 0, uint16_t rule50cnt = 0, 
              uint16_t enpassant_target_square = static_cast<uint16_t>(Map::CNT_SQUARES));
+    // Копия сохраняет запас аккумуляторов на всю ёмкость стека состояний: иначе первый же do_move
+    // в копии (корень потока поиска, параллельного perft) перевыделял бы вектор
+    Position(const Position &other);
+    Position &operator=(const Position &other);
     
     void set_from_fen(std::string_view fen_view);
     void do_move(Move m);
+    // Copy-make: дочерняя позиция пишется в out, текущая не меняется, отменять ход не нужно.
+    // Стек состояний out содержит только запись этого хода: state() работает, история партии для повторений - нет
+    void do_move(Move m, Position &out) const;
     void undo_move();
+    // Отбрасывает историю, не нужную для поиска повторений; undo_move после этого возможен только до нового корня.
+    // Вызывается перед заполнением стека состояний, иначе длинная партия его переполнит
+    void trim_history();
+    // Общая часть обоих do_move: ход на доске, ключи, оценка и запись в стек состояний; возвращает изменения для сети
+    NNUE::DirtyPieces make_move(Move m);
+
+    // Полный пересчёт ключа; в отладочной сборке сверяется с инкрементальным после каждого хода
+    uint64_t compute_key() const;
+    uint64_t compute_pawn_key() const;
+    // Полный пересчёт psq, используется при установке позиции и для сверки в отладочной сборке
+    PSQT::Score compute_psq() const;
+
+    // Заводит стек аккумуляторов заново, если сеть загружена
+    void refresh_accumulators();
+
+    // Полный пересчёт attacks_from по текущей расстановке
+    void compute_attacks();
+    // Пересчитывает атаки фигур на изменившихся полях и дальнобойных фигур, чьи лучи через них проходят
+    void update_attacks(Bitboard changed);
+};
+
+// Способ делать ходы при обходе дерева
+enum class MakeMode
+{
+    MAKE_UNMAKE, // do_move/undo_move над одной позицией
+    COPY_MAKE,   // do_move(m, out) в слот следующего уровня, отмена - возврат к предыдущему слоту
+};
+
+// Текущая позиция обхода и переходы по ходам: код обхода пишется один раз и работает в обоих режимах
+template <MakeMode M>
+class PositionStack;
+
+template <>
+class PositionStack<MakeMode::MAKE_UNMAKE>
+{
+public:
+    explicit PositionStack(Position &root) : pos(root) {}
+
+    Position &current() { return pos; }
+    void make(Move m) { pos.do_move(m); }
+    void unmake() { pos.undo_move(); }
+
+private:
+    Position &pos;
+};
+
+template <>
+class PositionStack<MakeMode::COPY_MAKE>
+{
+public:
+    // Слоты выделяются при первом reset и переиспользуются: стек живёт дольше одного обхода
+    void reset(const Position &root)
+    {
+        if (!slots)
+        {
+            slots = std::make_unique<Slots>();
+        }
+        (*slots)[0] = root;
+        ply = 0;
+        // Дочерней позиции нужен один аккумулятор: выделяем его здесь, а не при первом ходе в обходе
+        if (!root.accumulators.empty())
+        {
+            for (Position &slot : *slots)
+            {
+                slot.accumulators.reserve(1);
+            }
+        }
+    }
+
+    Position &current() { return (*slots)[ply]; }
+    void make(Move m)
+    {
+        (*slots)[ply].do_move(m, (*slots)[ply + 1]);
+        ++ply;
+    }
+    void unmake() { --ply; }
+
+private:
+    // Слот на каждый уровень дерева; ход переписывает ядро слота и одну-две записи его стека состояний
+    using Slots = std::array<Position, static_cast<size_t>(Map::MAX_PLY) + 1>;
+    std::unique_ptr<Slots> slots;
+    size_t ply = 0;
 };
 
 // === ШАБЛОННЫЕ СПЕЦИАЛИЗАЦИИ ===
@@ -282,6 +548,7 @@ struct std::formatter<Position> {
             out = std::format_to(out, "En passant:   {}\n", Position::get_enpassant_str(pos));
             out = std::format_to(out, "Rule 50:      {}\n", pos.rule50cnt);
             out = std::format_to(out, "Features raw: {:#04x}\n", pos.features);
+            out = std::format_to(out, "Key:          {:016X}\n", pos.key);
             out = std::format_to(out, "King squares : White {}, Black {}\n", FEN::index_to_square(pos.king_sq[static_cast<size_t>(Color::WHITE)]), FEN::index_to_square(pos.king_sq[static_cast<size_t>(Color::BLACK)]));
         }
         return out;
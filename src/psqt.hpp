@@ -0,0 +1,34 @@
+#pragma once
+#include "types.h"
+#include <bits/stdc++.h>
+
+namespace PSQT
+{
+    // Пара оценок (миттельшпиль, эндшпиль) в одном int32: младшие 16 бит - mg, старшие - eg.
+    // Складывается и вычитается как обычное число, поэтому сумма по всем фигурам обновляется одной операцией
+    using Score = int32_t;
+
+    constexpr inline Score make_score(int mg, int eg)
+    {
+        return static_cast<Score>(static_cast<uint32_t>(eg) << 16) + mg;
+    }
+
+    constexpr inline int mg_value(Score s)
+    {
+        return static_cast<int16_t>(static_cast<uint16_t>(static_cast<uint32_t>(s)));
+    }
+
+    constexpr inline int eg_value(Score s)
+    {
+        return static_cast<int16_t>(static_cast<uint16_t>(static_cast<uint32_t>(s + 0x8000) >> 16));
+    }
+
+    // Вес фигур в фазе партии, индекс - PieceType; в начальной позиции сумма равна MAX_PHASE
+    constexpr std::array<int, static_cast<size_t>(PieceType::QUEEN) + 1> PHASE_WEIGHT = {0, 0, 0, 1, 1, 2, 4};
+    constexpr int MAX_PHASE = 24;
+
+    // Материал + таблица для фигуры на поле: [код фигуры][поле], с точки зрения белых (для чёрных со знаком минус)
+    extern std::array<std::array<Score, static_cast<size_t>(Map::CNT_SQUARES)>, 16> psq;
+
+    void init();
+} // namespace PSQT
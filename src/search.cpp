@@ -0,0 +1,614 @@
+#include "search.hpp"
+#include "evaluate.hpp"
+#include "tt.hpp"
+#include "movepick.hpp"
+
+namespace Search
+{
+    namespace
+    {
+        // Как часто сверяться с часами: системный вызов на каждом узле заметно дороже самого узла
+        constexpr uint64_t TIME_CHECK_INTERVAL = 1024;
+
+        // Запас delta pruning: позиционная компенсация, которую взятие может дать сверх стоимости жертвы
+        constexpr int DELTA_MARGIN = 200;
+
+        // В таблице мат хранится относительно текущего узла, а не корня: так запись верна при любом пути к позиции
+        constexpr int score_to_tt(int score, int ply)
+        {
+            return score >= VALUE_MATE_IN_MAX_PLY ? score + ply : score <= -VALUE_MATE_IN_MAX_PLY ? score - ply : score;
+        }
+        constexpr int score_from_tt(int score, int ply)
+        {
+            return score >= VALUE_MATE_IN_MAX_PLY ? score - ply : score <= -VALUE_MATE_IN_MAX_PLY ? score + ply : score;
+        }
+
+        constexpr bool has_bound(TT::Bound bound, TT::Bound flag)
+        {
+            return static_cast<uint8_t>(bound) & static_cast<uint8_t>(flag);
+        }
+
+        std::string score_to_uci(int score)
+        {
+            if (score >= VALUE_MATE_IN_MAX_PLY)
+            {
+                return std::format("mate {}", (VALUE_MATE - score + 1) / 2);
+            }
+            if (score <= -VALUE_MATE_IN_MAX_PLY)
+            {
+                return std::format("mate {}", -(VALUE_MATE + score) / 2);
+            }
+            return std::format("cp {}", score);
+        }
+    } // namespace
+
+    Worker::Worker(const Position &root, const Limits &limits, const std::atomic<bool> &stop_signal, size_t id, const Team &team,
+                   MovePick::Heuristics &heuristics, Pawns::Table &pawns, MakeMode make_mode, PositionStack<MakeMode::COPY_MAKE> &copy_positions)
+        : root(root), positions(this->root), make_mode(make_mode), copy_positions(copy_positions), limits(limits), stop_signal(stop_signal), id(id), team(team),
+          heuristics(heuristics), pawns(pawns), start_time(std::chrono::steady_clock::now()), stack(std::make_unique<MoveGen::MoveStack>())
+    {
+        if (make_mode == MakeMode::COPY_MAKE)
+        {
+            copy_positions.reset(root);
+        }
+        // Дальше последнего необратимого хода повторение не ищется: копируем только этот хвост партии.
+        // states[i].key - позиция перед i-м ходом, поэтому позиция за k полуходов до корня - states[ply - k + 1]
+        const size_t game_ply = root.states.ply();
+        root_index = std::min({game_ply, static_cast<size_t>(root.rule50cnt), GAME_KEYS});
+        for (size_t i = 0; i < root_index; ++i)
+        {
+            keys[i] = root.states[game_ply - root_index + 1 + i].key;
+        }
+
+        // Помощники работают, пока главный поток их не остановит
+        if (!is_main())
+        {
+            this->limits = Limits{};
+        }
+        const size_t us = static_cast<size_t>(Position::get_side_to_move(root));
+        if (is_main() && !limits.infinite && limits.time[us] != 0)
+        {
+            time_manager.init(limits.time[us], limits.inc[us], limits.movestogo);
+        }
+        if (this->limits.depth <= 0 || this->limits.depth >= static_cast<int>(Map::MAX_PLY))
+        {
+            this->limits.depth = static_cast<int>(Map::MAX_PLY) - 1;
+        }
+    }
+
+    int64_t Worker::elapsed_ms() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    }
+
+    uint64_t Worker::total_nodes() const
+    {
+        uint64_t total = 0;
+        for (const std::unique_ptr<Worker> &worker : team)
+        {
+            total += worker->nodes.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void Worker::check_limits()
+    {
+        // Флаг читается на каждом узле: relaxed-загрузка почти бесплатна, а stop должен срабатывать за доли миллисекунды
+        if (stop_signal.load(std::memory_order_relaxed))
+        {
+            stopped = true;
+        }
+        if (!is_main())
+        {
+            return;
+        }
+        // Свои узлы сверяем на каждом узле - в одном потоке лимит точный, общую сумму - реже
+        const uint64_t own = nodes.load(std::memory_order_relaxed);
+        if (limits.nodes != 0 && own >= limits.nodes)
+        {
+            stopped = true;
+        }
+        if (own % TIME_CHECK_INTERVAL == 0)
+        {
+            if ((limits.nodes != 0 && total_nodes() >= limits.nodes) ||
+                (limits.movetime != 0 && elapsed_ms() >= limits.movetime) ||
+                (time_manager.enabled() && elapsed_ms() >= time_manager.maximum()))
+            {
+                stopped = true;
+            }
+        }
+    }
+
+    bool Worker::is_draw(const Position &pos, int ply) const
+    {
+        if (pos.rule50cnt >= 100)
+        {
+            return true;
+        }
+        // Повторение: та же позиция могла быть только через чётное число полуходов и не раньше последнего необратимого хода
+        const int current = static_cast<int>(root_index) + ply;
+        const int end = std::max(0, current - static_cast<int>(pos.rule50cnt));
+        for (int i = current - 2; i >= end; i -= 2)
+        {
+            if (keys[i] == pos.key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Worker::update_pv(int ply, Move move)
+    {
+        pv[ply][ply] = move;
+        for (int i = ply + 1; i < pv_length[ply + 1]; ++i)
+        {
+            pv[ply][i] = pv[ply + 1][i];
+        }
+        pv_length[ply] = pv_length[ply + 1];
+    }
+
+    template <MakeMode M>
+    int Worker::qsearch(PositionStack<M> &positions, int alpha, int beta, int ply)
+    {
+        const Position &pos = positions.current();
+        pv_length[ply] = ply;
+        nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        check_limits();
+        if (stopped)
+        {
+            return 0;
+        }
+
+        keys[root_index + ply] = pos.key;
+        if (is_draw(pos, ply))
+        {
+            return VALUE_DRAW;
+        }
+        if (ply >= static_cast<int>(Map::MAX_PLY) - 1)
+        {
+            return Eval::evaluate(pos, pawns);
+        }
+
+        const bool pv_node = beta - alpha > 1;
+        Move tt_move = Move::none();
+        TT::Entry tte;
+        if (TT::g_table.probe(pos.key, tte))
+        {
+            tt_move = tte.move;
+            const int tt_score = score_from_tt(tte.score, ply);
+            if (!pv_node && tte.depth >= 0 &&
+                ((has_bound(tte.bound, TT::Bound::LOWER) && tt_score >= beta) ||
+                 (has_bound(tte.bound, TT::Bound::UPPER) && tt_score <= alpha)))
+            {
+                return tt_score;
+            }
+        }
+
+        const Color us = static_cast<Color>(Position::get_side_to_move(pos));
+        const Color them = static_cast<Color>(!Position::get_side_to_move(pos));
+        const bool in_check = pos.attacked_by(them) & BB::square_bb(pos.king_sq[static_cast<size_t>(us)]);
+
+        // Stand pat: без шаха сторона не обязана брать, оценка позиции - нижняя граница.
+        // Под шахом перебираем все ответы, иначе мат за горизонтом не виден
+        int best_score = -VALUE_INFINITE;
+        int stand_pat = -VALUE_INFINITE;
+        if (!in_check)
+        {
+            stand_pat = best_score = Eval::evaluate(pos, pawns);
+            if (stand_pat >= beta)
+            {
+                return stand_pat;
+            }
+            alpha = std::max(alpha, stand_pat);
+        }
+
+        const int orig_alpha = alpha;
+        Move best_move = Move::none();
+        int move_count = 0;
+
+        auto search_moves = [&](auto &picker)
+        {
+            for (Move move = picker.next_move(); move != Move::none(); move = picker.next_move())
+            {
+                ++move_count;
+                // Delta pruning: даже выиграв жертву с запасом, не дотянуть до alpha
+                if (!in_check && move.type() != MoveType::PROMOTION)
+                {
+                    const PieceType victim = move.type() == MoveType::EN_PASSANT ? PieceType::PAWN : FEN::get_piece_type(pos.piece_on(move.dest()));
+                    if (stand_pat + Eval::PIECE_VALUE[static_cast<size_t>(victim)] + DELTA_MARGIN <= alpha)
+                    {
+                        continue;
+                    }
+                }
+
+                positions.make(move);
+                const int score = -qsearch(positions, -beta, -alpha, ply + 1);
+                positions.unmake();
+
+                if (stopped)
+                {
+                    return;
+                }
+                if (score <= best_score)
+                {
+                    continue;
+                }
+                best_score = score;
+                if (score > alpha)
+                {
+                    alpha = score;
+                    best_move = move;
+                    update_pv(ply, move);
+                    if (alpha >= beta)
+                    {
+                        return;
+                    }
+                }
+            }
+        };
+
+        if (in_check)
+        {
+            MovePick::MovePicker<MoveGen::GenType::LEGAL> picker(pos, tt_move, heuristics, ply, (*stack)[ply]);
+            search_moves(picker);
+        }
+        else
+        {
+            MovePick::MovePicker<MoveGen::GenType::CAPTURES> picker(pos, tt_move, heuristics, ply, (*stack)[ply]);
+            search_moves(picker);
+        }
+        if (stopped)
+        {
+            return 0;
+        }
+
+        if (in_check && move_count == 0)
+        {
+            return mated_in(ply);
+        }
+
+        const TT::Bound bound = best_score >= beta ? TT::Bound::LOWER : alpha > orig_alpha ? TT::Bound::EXACT : TT::Bound::UPPER;
+        TT::g_table.store(pos.key, best_move, score_to_tt(best_score, ply), stand_pat == -VALUE_INFINITE ? VALUE_NONE : stand_pat, 0, bound);
+        return best_score;
+    }
+
+    template <MakeMode M>
+    int Worker::search(PositionStack<M> &positions, int alpha, int beta, int depth, int ply)
+    {
+        if (depth <= 0)
+        {
+            return qsearch(positions, alpha, beta, ply);
+        }
+
+        const Position &pos = positions.current();
+        pv_length[ply] = ply;
+        nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        check_limits();
+        if (stopped)
+        {
+            return 0;
+        }
+
+        keys[root_index + ply] = pos.key;
+        if (ply > 0 && is_draw(pos, ply))
+        {
+            return VALUE_DRAW;
+        }
+        if (ply >= static_cast<int>(Map::MAX_PLY) - 1)
+        {
+            return Eval::evaluate(pos, pawns);
+        }
+
+        const bool pv_node = beta - alpha > 1;
+        Move tt_move = Move::none();
+        TT::Entry tte;
+        if (TT::g_table.probe(pos.key, tte))
+        {
+            tt_move = tte.move;
+            const int tt_score = score_from_tt(tte.score, ply);
+            if (!pv_node && ply > 0 && tte.depth >= depth &&
+                ((has_bound(tte.bound, TT::Bound::LOWER) && tt_score >= beta) ||
+                 (has_bound(tte.bound, TT::Bound::UPPER) && tt_score <= alpha)))
+            {
+                return tt_score;
+            }
+        }
+
+        const Color us = static_cast<Color>(Position::get_side_to_move(pos));
+        const Color them = static_cast<Color>(!Position::get_side_to_move(pos));
+
+        int best_score = -VALUE_INFINITE;
+        Move best_move = Move::none();
+        const int orig_alpha = alpha;
+        int move_count = 0;
+        // Тихие ходы, не давшие отсечения: при отсечении их история штрафуется
+        std::array<Move, 64> quiets_tried;
+        size_t quiet_count = 0;
+
+        MovePick::MovePicker<MoveGen::GenType::LEGAL> picker(pos, tt_move, heuristics, ply, (*stack)[ply]);
+        for (Move move = picker.next_move(); move != Move::none(); move = picker.next_move())
+        {
+            ++move_count;
+            const bool is_quiet = move.type() != MoveType::PROMOTION && move.type() != MoveType::EN_PASSANT &&
+                                  !(pos.pieces(them) & BB::square_bb(move.dest()));
+
+            positions.make(move);
+            const int score = -search(positions, -beta, -alpha, depth - 1, ply + 1);
+            positions.unmake();
+
+            if (stopped)
+            {
+                return 0;
+            }
+            if (score <= best_score)
+            {
+                if (is_quiet && quiet_count < quiets_tried.size())
+                {
+                    quiets_tried[quiet_count++] = move;
+                }
+                continue;
+            }
+            best_score = score;
+            if (score > alpha)
+            {
+                alpha = score;
+                best_move = move;
+                update_pv(ply, move);
+
+                if (alpha >= beta)
+                {
+                    // Тихий ход, давший отсечение, скорее всего сработает и в соседних позициях
+                    if (is_quiet)
+                    {
+                        const int bonus = depth * depth;
+                        heuristics.update_killers(ply, move);
+                        heuristics.update_countermove(pos, move);
+                        heuristics.update_history(us, move, bonus);
+                        for (size_t i = 0; i < quiet_count; ++i)
+                        {
+                            heuristics.update_history(us, quiets_tried[i], -bonus);
+                        }
+                    }
+                    break;
+                }
+            }
+            if (is_quiet && quiet_count < quiets_tried.size())
+            {
+                quiets_tried[quiet_count++] = move;
+            }
+        }
+
+        if (move_count == 0)
+        {
+            const bool in_check = pos.attacked_by(them) & BB::square_bb(pos.king_sq[static_cast<size_t>(us)]);
+            return in_check ? mated_in(ply) : VALUE_DRAW;
+        }
+
+        const TT::Bound bound = best_score >= beta ? TT::Bound::LOWER : alpha > orig_alpha ? TT::Bound::EXACT : TT::Bound::UPPER;
+        TT::g_table.store(pos.key, best_move, score_to_tt(best_score, ply), VALUE_NONE, depth, bound);
+        return best_score;
+    }
+
+    void Worker::report(int depth, int score) const
+    {
+        const int64_t elapsed = elapsed_ms();
+        const uint64_t nodes = total_nodes();
+        std::string line = std::format("info depth {} score {} nodes {} nps {} time {} hashfull {} pv",
+                                       depth, score_to_uci(score), nodes, nodes * 1000 / std::max<int64_t>(elapsed, 1),
+                                       elapsed, TT::g_table.hashfull());
+        for (int i = 0; i < pv_length[0]; ++i)
+        {
+            line += std::format(" {}", pv[0][i]);
+        }
+        std::println("{}", line);
+    }
+
+    void Worker::iterative_deepening()
+    {
+        Move best_move = Move::none();
+        pv_length[0] = 0;
+        // Затухающий счётчик смен лучшего хода между итерациями: чем он больше, тем дольше думаем
+        double best_move_changes = 0.0;
+
+        for (int depth = 1; depth <= limits.depth; ++depth)
+        {
+            // Нечётные помощники идут на полуход впереди главного, чтобы команда не искала одну глубину одновременно:
+            // их записи в TT готовят следующую итерацию, пока остальные досчитывают текущую
+            const int search_depth = is_main() ? depth : std::min(depth + static_cast<int>(id % 2), limits.depth);
+            const int score = make_mode == MakeMode::COPY_MAKE ? search(copy_positions, -VALUE_INFINITE, VALUE_INFINITE, search_depth, 0)
+                                                               : search(positions, -VALUE_INFINITE, VALUE_INFINITE, search_depth, 0);
+            if (stopped)
+            {
+                // Недосчитанную итерацию не используем, кроме первой: иначе хода не будет вовсе
+                if (best_move == Move::none() && pv_length[0] > 0)
+                {
+                    best_move = pv[0][0];
+                }
+                break;
+            }
+            if (pv_length[0] > 0)
+            {
+                best_move_changes = best_move_changes / 2 + (best_move != pv[0][0] && best_move != Move::none() ? 1.0 : 0.0);
+                best_move = pv[0][0];
+            }
+            if (is_main())
+            {
+                report(depth, score);
+                // Следующую итерацию не начинаем: она почти наверняка не уложится в оставшееся время
+                if (time_manager.enabled() && elapsed_ms() >= time_manager.optimum(best_move_changes))
+                {
+                    break;
+                }
+            }
+        }
+
+        if (!is_main())
+        {
+            return;
+        }
+
+        // В режиме infinite bestmove выводится только после stop, даже если перебор исчерпан
+        if (limits.infinite)
+        {
+            stop_signal.wait(false, std::memory_order_acquire);
+        }
+
+        // Остановлены до первого результата - отдаём любой легальный ход
+        if (best_move == Move::none())
+        {
+            MoveGen::MoveList &root_moves = (*stack)[0];
+            root_moves.clear();
+            MoveGen::generate_moves(root, root_moves);
+            if (!root_moves.empty())
+            {
+                best_move = root_moves.front().move;
+            }
+        }
+
+        // Позиция без ходов (мат или пат): GUI ждут нулевой ход
+        if (best_move == Move::none())
+        {
+            std::println("bestmove 0000");
+            return;
+        }
+        std::println("bestmove {}", best_move);
+    }
+
+    SearchThread g_thread;
+
+    SearchThread::SearchThread() : thread(&SearchThread::idle_loop, this) {}
+
+    SearchThread::~SearchThread()
+    {
+        stop();
+        {
+            std::lock_guard lock(mutex);
+            exit = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    void SearchThread::go(const Position &root, const Limits &limits)
+    {
+        {
+            std::lock_guard lock(mutex);
+            const uint64_t id = ++go_count;
+            jobs.emplace_back([this, root, limits, id]
+            {
+                {
+                    // Флаг выставляем при старте, а не при постановке: иначе новый go отменил бы stop,
+                    // ещё не замеченный идущим поиском
+                    std::lock_guard lock(mutex);
+                    stop_flag.store(id <= stopped_go, std::memory_order_relaxed);
+                }
+                TT::g_table.new_search();
+                while (heuristics.size() < threads)
+                {
+                    heuristics.push_back(std::make_unique<MovePick::Heuristics>());
+                    heuristics.back()->clear();
+                    pawn_tables.push_back(std::make_unique<Pawns::Table>());
+                    position_stacks.push_back(std::make_unique<PositionStack<MakeMode::COPY_MAKE>>());
+                }
+
+                Team team;
+                for (size_t id = 0; id < threads; ++id)
+                {
+                    heuristics[id]->age();
+                    team.push_back(std::make_unique<Worker>(root, limits, stop_flag, id, team, *heuristics[id], *pawn_tables[id], make_mode,
+                                                            *position_stacks[id]));
+                }
+
+                std::vector<std::thread> helpers;
+                for (size_t id = 1; id < team.size(); ++id)
+                {
+                    helpers.emplace_back(&Worker::iterative_deepening, team[id].get());
+                }
+                team[0]->iterative_deepening();
+
+                // Главный закончил - останавливаем помощников; следующий go выставит флаг заново
+                stop_flag.store(true, std::memory_order_release);
+                for (std::thread &helper : helpers)
+                {
+                    helper.join();
+                }
+                last_nodes = team[0]->total_nodes();
+            });
+        }
+        cv.notify_all();
+    }
+
+    void SearchThread::stop()
+    {
+        std::lock_guard lock(mutex);
+        stopped_go = go_count;
+        stop_flag.store(true, std::memory_order_release);
+        stop_flag.notify_all();
+    }
+
+    void SearchThread::post(std::function<void()> job)
+    {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_all();
+    }
+
+    void SearchThread::clear()
+    {
+        post([this]
+        {
+            TT::g_table.clear();
+            for (std::unique_ptr<MovePick::Heuristics> &h : heuristics)
+            {
+                h->clear();
+            }
+            for (std::unique_ptr<Pawns::Table> &t : pawn_tables)
+            {
+                t->clear();
+            }
+        });
+    }
+
+    Pawns::Stats SearchThread::pawn_stats() const
+    {
+        Pawns::Stats total;
+        for (const std::unique_ptr<Pawns::Table> &t : pawn_tables)
+        {
+            total.probes += t->stats.probes;
+            total.hits += t->stats.hits;
+        }
+        return total;
+    }
+
+    void SearchThread::wait()
+    {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] { return jobs.empty() && !busy; });
+    }
+
+    void SearchThread::idle_loop()
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            cv.wait(lock, [this] { return exit || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+
+            lock.unlock();
+            job();
+            lock.lock();
+
+            busy = false;
+            cv.notify_all();
+        }
+    }
+} // namespace Search
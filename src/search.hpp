@@ -0,0 +1,148 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include "movegen.hpp"
+#include "timeman.hpp"
+#include "movepick.hpp"
+#include "pawns.hpp"
+#include <bits/stdc++.h>
+
+namespace Search
+{
+    constexpr int VALUE_DRAW = 0;
+    constexpr int VALUE_MATE = 32000;
+    constexpr int VALUE_INFINITE = 32001;
+    constexpr int VALUE_NONE = 32002;
+    // Оценки не меньше этой - мат в пределах дерева перебора
+    constexpr int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - static_cast<int>(Map::MAX_PLY);
+
+    constexpr int mate_in(int ply) { return VALUE_MATE - ply; }
+    constexpr int mated_in(int ply) { return -VALUE_MATE + ply; }
+
+    // Ограничения из команды go; 0 - ограничения нет
+    struct Limits
+    {
+        int depth = 0;
+        uint64_t nodes = 0;
+        int64_t movetime = 0; // мс
+        bool infinite = false;
+        // Часы партии по цветам, мс; время на ход из них считает TimeMan
+        std::array<int64_t, 2> time{};
+        std::array<int64_t, 2> inc{};
+        int movestogo = 0;
+    };
+
+    class Worker;
+    using Team = std::vector<std::unique_ptr<Worker>>;
+
+    // Lazy SMP: все потоки ищут из одного корня с общей TT, каждый со своей копией позиции.
+    // Главный (id 0) следит за лимитами и печатает результат, помощники лишь наполняют таблицу.
+    // Ходы делаются в режиме make_mode; в режиме copy-make позиции дерева лежат в copy_positions
+    class Worker
+    {
+    public:
+        Worker(const Position &root, const Limits &limits, const std::atomic<bool> &stop_signal, size_t id, const Team &team,
+               MovePick::Heuristics &heuristics, Pawns::Table &pawns, MakeMode make_mode, PositionStack<MakeMode::COPY_MAKE> &copy_positions);
+
+        // Итеративное углубление до исчерпания лимитов; главный поток печатает info и bestmove
+        void iterative_deepening();
+
+        // Читается другими потоками: пишет только владелец, поэтому хватает relaxed без атомарного инкремента
+        std::atomic<uint64_t> nodes{0};
+        // Сумма узлов всей команды
+        uint64_t total_nodes() const;
+
+    private:
+        // Сколько позиций партии перед корнем нужно для поиска повторений: после 100 обратимых полуходов и так ничья
+        static constexpr size_t GAME_KEYS = 100;
+
+        template <MakeMode M>
+        int search(PositionStack<M> &positions, int alpha, int beta, int depth, int ply);
+        // Форсированный поиск на горизонте: только взятия и превращения, под шахом - все ответы
+        template <MakeMode M>
+        int qsearch(PositionStack<M> &positions, int alpha, int beta, int ply);
+        void update_pv(int ply, Move move);
+        // Ничья правилом 50 ходов или повторением; ключ pos уже записан в keys[root_index + ply]
+        bool is_draw(const Position &pos, int ply) const;
+        void check_limits();
+        int64_t elapsed_ms() const;
+        void report(int depth, int score) const;
+        bool is_main() const { return id == 0; }
+
+        Position root;
+        PositionStack<MakeMode::MAKE_UNMAKE> positions; // над root
+        MakeMode make_mode;
+        PositionStack<MakeMode::COPY_MAKE> &copy_positions;
+        Limits limits;
+        const std::atomic<bool> &stop_signal; // выставляется командой stop или главным потоком по окончании
+        size_t id;
+        const Team &team;
+        MovePick::Heuristics &heuristics;
+        Pawns::Table &pawns;
+        std::chrono::steady_clock::time_point start_time;
+        TimeMan::TimeManager time_manager;
+        bool stopped = false;
+
+        std::unique_ptr<MoveGen::MoveStack> stack;
+
+        // Ключи позиций по полуходам: хвост партии перед корнем, затем путь поиска (keys[root_index + ply]).
+        // Не зависит от режима ходов: в copy-make у позиций дерева нет истории партии
+        std::array<uint64_t, GAME_KEYS + static_cast<size_t>(Map::MAX_PLY)> keys;
+        size_t root_index = 0;
+
+        // Треугольная таблица главных вариантов: pv[ply] - лучшая линия начиная с ply
+        std::array<std::array<Move, static_cast<size_t>(Map::MAX_PLY)>, static_cast<size_t>(Map::MAX_PLY)> pv;
+        std::array<int, static_cast<size_t>(Map::MAX_PLY)> pv_length;
+    };
+
+    // Поток поиска: выполняет задания из очереди по одному, пока поток ввода продолжает читать команды.
+    // Так stop и isready обрабатываются сразу, а не после окончания поиска
+    class SearchThread
+    {
+    public:
+        SearchThread();
+        ~SearchThread();
+
+        // Ставит поиск из копии root в очередь и сразу возвращается; bestmove выводит поток поиска
+        void go(const Position &root, const Limits &limits);
+        // Прерывает текущий поиск и все поставленные до этой команды, каждый выведет bestmove
+        void stop();
+        // Ставит задание в очередь и сразу возвращается: так меняются таблицы и параметры, которые читает поиск
+        void post(std::function<void()> job);
+        // Ждёт, пока очередь опустеет, - для команд, которым нужен результат поиска (bench, quit)
+        void wait();
+        // Число потоков Lazy SMP; вызывать из задания очереди (post), действует со следующего go
+        void set_threads(size_t n) { threads = std::max<size_t>(n, 1); }
+        // Способ делать ходы в поиске; так же из задания очереди
+        void set_make_mode(MakeMode mode) { make_mode = mode; }
+        // Новая партия: ставит в очередь обнуление TT, эвристик упорядочивания и кэшей пешек всех потоков
+        void clear();
+        // Попадания в кэши пешек всех потоков с последнего clear(), читать после wait()
+        Pawns::Stats pawn_stats() const;
+        // Узлы всех потоков за последний завершённый поиск, читать после wait()
+        uint64_t nodes_searched() const { return last_nodes; }
+
+    private:
+        void idle_loop();
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> jobs;
+        bool busy = false;
+        bool exit = false;
+        // Номер последнего поставленного go и последнего, до которого дошёл stop (оба под mutex):
+        // go, поставленный раньше stop, начинается уже остановленным
+        uint64_t go_count = 0;
+        uint64_t stopped_go = 0;
+        std::atomic<bool> stop_flag{false};
+        size_t threads = 1;
+        MakeMode make_mode = MakeMode::MAKE_UNMAKE;
+        uint64_t last_nodes = 0;
+        std::vector<std::unique_ptr<MovePick::Heuristics>> heuristics; // по одной на поток, трогает только поток поиска
+        std::vector<std::unique_ptr<Pawns::Table>> pawn_tables;        // так же, по одной на поток
+        std::vector<std::unique_ptr<PositionStack<MakeMode::COPY_MAKE>>> position_stacks; // слоты copy-make, по одному стеку на поток
+        std::thread thread; // последним: запускается, когда остальные поля уже готовы
+    };
+
+    extern SearchThread g_thread;
+} // namespace Search
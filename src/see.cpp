@@ -0,0 +1,91 @@
+#include "see.hpp"
+#include "evaluate.hpp"
+
+namespace SEE
+{
+    bool see(const Position &pos, Move move, int threshold)
+    {
+        if (move.type() != MoveType::NORMAL)
+        {
+            return 0 >= threshold;
+        }
+
+        const uint16_t from_sq = move.source();
+        const uint16_t to_sq = move.dest();
+        auto value_on = [&](uint16_t sq) { return Eval::PIECE_VALUE[static_cast<size_t>(FEN::get_piece_type(pos.piece_on(sq)))]; };
+
+        // swap - баланс с точки зрения стороны, которой предстоит решать, бить ли дальше
+        int swap = value_on(to_sq) - threshold;
+        if (swap < 0)
+        {
+            return false;
+        }
+        swap = value_on(from_sq) - swap;
+        if (swap <= 0)
+        {
+            return true;
+        }
+
+        Bitboard occupied = pos.occupied ^ BB::square_bb(from_sq) ^ BB::square_bb(to_sq);
+        Color stm = static_cast<Color>(Position::get_side_to_move(pos));
+        Bitboard attackers = pos.attackers_to(to_sq, occupied);
+        const Bitboard diagonal = pos.pieces(PieceType::BISHOP) | pos.pieces(PieceType::QUEEN);
+        const Bitboard straight = pos.pieces(PieceType::ROOK) | pos.pieces(PieceType::QUEEN);
+        bool result = true;
+
+        while (true)
+        {
+            stm = static_cast<Color>(static_cast<uint16_t>(stm) ^ 1);
+            attackers &= occupied;
+            const Bitboard stm_attackers = attackers & pos.pieces(stm);
+            if (!stm_attackers)
+            {
+                break;
+            }
+            result = !result;
+
+            // Самый дешёвый нападающий; после его снятия открываются дальнобойные за ним
+            Bitboard bb;
+            if ((bb = stm_attackers & pos.pieces(PieceType::PAWN)))
+            {
+                if ((swap = Eval::PIECE_VALUE[static_cast<size_t>(PieceType::PAWN)] - swap) < result)
+                    break;
+                occupied ^= BB::square_bb(BB::lsb(bb));
+                attackers |= BB::bishop_attacks(to_sq, occupied) & diagonal;
+            }
+            else if ((bb = stm_attackers & pos.pieces(PieceType::KNIGHT)))
+            {
+                if ((swap = Eval::PIECE_VALUE[static_cast<size_t>(PieceType::KNIGHT)] - swap) < result)
+                    break;
+                occupied ^= BB::square_bb(BB::lsb(bb));
+            }
+            else if ((bb = stm_attackers & pos.pieces(PieceType::BISHOP)))
+            {
+                if ((swap = Eval::PIECE_VALUE[static_cast<size_t>(PieceType::BISHOP)] - swap) < result)
+                    break;
+                occupied ^= BB::square_bb(BB::lsb(bb));
+                attackers |= BB::bishop_attacks(to_sq, occupied) & diagonal;
+            }
+            else if ((bb = stm_attackers & pos.pieces(PieceType::ROOK)))
+            {
+                if ((swap = Eval::PIECE_VALUE[static_cast<size_t>(PieceType::ROOK)] - swap) < result)
+                    break;
+                occupied ^= BB::square_bb(BB::lsb(bb));
+                attackers |= BB::rook_attacks(to_sq, occupied) & straight;
+            }
+            else if ((bb = stm_attackers & pos.pieces(PieceType::QUEEN)))
+            {
+                if ((swap = Eval::PIECE_VALUE[static_cast<size_t>(PieceType::QUEEN)] - swap) < result)
+                    break;
+                occupied ^= BB::square_bb(BB::lsb(bb));
+                attackers |= (BB::bishop_attacks(to_sq, occupied) & diagonal) | (BB::rook_attacks(to_sq, occupied) & straight);
+            }
+            else
+            {
+                // Король бьёт, только если у соперника не осталось нападающих
+                return (attackers & ~pos.pieces(stm)) ? !result : result;
+            }
+        }
+        return result;
+    }
+} // namespace SEE
@@ -0,0 +1,12 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include <bits/stdc++.h>
+
+namespace SEE
+{
+    // Static Exchange Evaluation: не хуже ли threshold размен на поле хода, если обе стороны бьют
+    // туда самой дешёвой фигурой. Ходы не делаются: фигуры снимаются с битовой занятости, а дальнобойные
+    // за ними (x-ray) добавляются в атакующие. Рокировка, взятие на проходе и превращение считаются равным разменом
+    bool see(const Position &pos, Move move, int threshold);
+} // namespace SEE
@@ -0,0 +1,21 @@
+#include "timeman.hpp"
+
+namespace TimeMan
+{
+    void TimeManager::init(int64_t time_left, int64_t increment, int moves_to_go)
+    {
+        active = true;
+        const int64_t available = std::max<int64_t>(time_left - MOVE_OVERHEAD, 1);
+        const int64_t moves = moves_to_go > 0 ? std::min(moves_to_go, 50) : DEFAULT_MOVES_TO_GO;
+
+        // Поровну на оставшиеся ходы плюс большая часть прибавки; на один ход - не больше 4/5 остатка
+        const int64_t base = available / moves + increment * 3 / 4;
+        hard = std::min(available * 4 / 5, base * 5);
+        soft = std::min(base, hard);
+    }
+
+    int64_t TimeManager::optimum(double instability) const
+    {
+        return std::min(hard, static_cast<int64_t>(soft * (1.0 + std::clamp(instability, 0.0, 1.0))));
+    }
+} // namespace TimeMan
@@ -0,0 +1,29 @@
+#pragma once
+#include "types.h"
+#include <bits/stdc++.h>
+
+namespace TimeMan
+{
+    // Запас на задержки GUI и канала: без него на малых контролях проигрываем по времени
+    constexpr int64_t MOVE_OVERHEAD = 30;
+    // Сколько ходов считаем оставшимися, если GUI не прислал movestogo
+    constexpr int DEFAULT_MOVES_TO_GO = 40;
+
+    // Лимиты на ход из оставшегося времени. Мягкий проверяется между итерациями углубления,
+    // жёсткий - внутри итерации и обрывает её
+    class TimeManager
+    {
+    public:
+        void init(int64_t time_left, int64_t increment, int moves_to_go);
+        bool enabled() const { return active; }
+
+        // Мягкий лимит растягивается при нестабильном лучшем ходе, instability в [0, 1], но не выходит за жёсткий
+        int64_t optimum(double instability) const;
+        int64_t maximum() const { return hard; }
+
+    private:
+        bool active = false;
+        int64_t soft = 0;
+        int64_t hard = 0;
+    };
+} // namespace TimeMan
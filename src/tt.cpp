@@ -0,0 +1,102 @@
+#include "tt.hpp"
+
+namespace TT
+{
+    Table g_table;
+
+    void Table::resize(size_t mb)
+    {
+        buckets.reset(); // сначала освобождаем старую таблицу, чтобы не держать обе сразу
+        bucket_count = std::max<size_t>(1, mb * 1024 * 1024 / sizeof(Bucket));
+        buckets = std::make_unique<Bucket[]>(bucket_count);
+        clear();
+    }
+
+    void Table::clear()
+    {
+        for (size_t i = 0; i < bucket_count; ++i)
+        {
+            for (Slot &slot : buckets[i].slots)
+            {
+                slot.key_xor_data.store(0, std::memory_order_relaxed);
+                slot.data.store(0, std::memory_order_relaxed);
+            }
+        }
+        generation = 0;
+    }
+
+    bool Table::probe(uint64_t key, Entry &entry) const
+    {
+        const Bucket &bucket = bucket_for(key);
+        for (const Slot &slot : bucket.slots)
+        {
+            const uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if ((slot.key_xor_data.load(std::memory_order_relaxed) ^ data) == key and data != 0)
+            {
+                entry = unpack(data);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Table::store(uint64_t key, Move move, int score, int eval, int depth, Bound bound)
+    {
+        Bucket &bucket = bucket_for(key);
+        Slot *replace = &bucket.slots[0];
+        int worst = std::numeric_limits<int>::max();
+
+        for (Slot &slot : bucket.slots)
+        {
+            const uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if (data == 0)
+            {
+                replace = &slot; // пустое место занимаем сразу, если позиции нет дальше в корзине
+                worst = std::numeric_limits<int>::min();
+                continue;
+            }
+            if ((slot.key_xor_data.load(std::memory_order_relaxed) ^ data) == key)
+            {
+                // Та же позиция: не теряем известный ход и не затираем заметно более глубокий результат этого поиска
+                if (move == Move::none())
+                {
+                    move = unpack(data).move;
+                }
+                if (bound != Bound::EXACT and generation_of(data) == generation and depth + 4 < depth_of(data))
+                {
+                    return;
+                }
+                replace = &slot;
+                break;
+            }
+
+            // Вытесняем запись с наименьшей глубиной, старые поколения - в первую очередь
+            const int age = (generation - generation_of(data)) & GENERATION_MASK;
+            const int value = depth_of(data) - 8 * age;
+            if (value < worst)
+            {
+                worst = value;
+                replace = &slot;
+            }
+        }
+
+        const uint64_t data = pack(move, score, eval, depth, bound, generation);
+        replace->data.store(data, std::memory_order_relaxed);
+        replace->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    int Table::hashfull() const
+    {
+        const size_t sample = std::min<size_t>(1000 / SLOTS_PER_BUCKET, bucket_count);
+        size_t used = 0;
+        for (size_t i = 0; i < sample; ++i)
+        {
+            for (const Slot &slot : buckets[i].slots)
+            {
+                const uint64_t data = slot.data.load(std::memory_order_relaxed);
+                used += data != 0 and generation_of(data) == generation;
+            }
+        }
+        return static_cast<int>(used * 1000 / (sample * SLOTS_PER_BUCKET));
+    }
+} // namespace TT
@@ -0,0 +1,98 @@
+#pragma once
+#include "types.h"
+#include "position.hpp"
+#include <bits/stdc++.h>
+
+namespace TT
+{
+    enum class Bound : uint8_t
+    {
+        NONE = 0,
+        UPPER = 1, // оценка не выше score (fail-low)
+        LOWER = 2, // оценка не ниже score (fail-high)
+        EXACT = UPPER | LOWER,
+    };
+
+    // Распакованное содержимое записи
+    struct Entry
+    {
+        Move move;
+        int16_t score;
+        int16_t eval;
+        int8_t depth;
+        Bound bound;
+    };
+
+    // Запись хранит ключ в виде key ^ data: если другой поток успел переписать одно из слов,
+    // проверка ключа при чтении не пройдёт - запись считается пустой. Мьютексы не нужны
+    struct Slot
+    {
+        std::atomic<uint64_t> key_xor_data;
+        std::atomic<uint64_t> data;
+    };
+
+    constexpr size_t SLOTS_PER_BUCKET = 4;
+
+    // Корзина ровно в одну кэш-линию: проба таблицы - один промах по памяти
+    struct alignas(64) Bucket
+    {
+        std::array<Slot, SLOTS_PER_BUCKET> slots;
+    };
+    static_assert(sizeof(Bucket) == 64);
+
+    class Table
+    {
+    public:
+        // Размер в мегабайтах, содержимое очищается
+        void resize(size_t mb);
+        void clear();
+        // Вызывается перед каждым поиском: старые записи вытесняются в первую очередь
+        void new_search() { generation = (generation + 1) & GENERATION_MASK; }
+
+        bool probe(uint64_t key, Entry &entry) const;
+        void store(uint64_t key, Move move, int score, int eval, int depth, Bound bound);
+        void prefetch(uint64_t key) const { __builtin_prefetch(&bucket_for(key)); }
+
+        // Заполненность в промилле по выборке первых записей, для UCI "info hashfull"
+        int hashfull() const;
+
+    private:
+        static constexpr uint8_t GENERATION_MASK = 0x3F; // 6 бит поколения + 2 бита границы в одном байте
+
+        // Упаковка: move 16 | score 16 | eval 16 | depth 8 | generation 6, bound 2
+        static constexpr uint64_t pack(Move move, int score, int eval, int depth, Bound bound, uint8_t generation)
+        {
+            return static_cast<uint64_t>(move.data) |
+                   static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16 |
+                   static_cast<uint64_t>(static_cast<uint16_t>(eval)) << 32 |
+                   static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 48 |
+                   static_cast<uint64_t>(generation << 2 | static_cast<uint8_t>(bound)) << 56;
+        }
+        static constexpr Entry unpack(uint64_t data)
+        {
+            return {Move(static_cast<uint16_t>(data)),
+                    static_cast<int16_t>(data >> 16),
+                    static_cast<int16_t>(data >> 32),
+                    static_cast<int8_t>(data >> 48),
+                    static_cast<Bound>((data >> 56) & 0x3)};
+        }
+        static constexpr uint8_t generation_of(uint64_t data) { return (data >> 58) & GENERATION_MASK; }
+        static constexpr int8_t depth_of(uint64_t data) { return static_cast<int8_t>(data >> 48); }
+
+        const Bucket &bucket_for(uint64_t key) const
+        {
+            // Старшие биты произведения равномерно отображают ключ на [0, bucket_count)
+            return buckets[static_cast<size_t>((static_cast<unsigned __int128>(key) * bucket_count) >> 64)];
+        }
+        Bucket &bucket_for(uint64_t key)
+        {
+            return const_cast<Bucket &>(std::as_const(*this).bucket_for(key));
+        }
+
+        std::unique_ptr<Bucket[]> buckets;
+        size_t bucket_count = 0;
+        uint8_t generation = 0;
+    };
+
+    extern Table g_table;
+} // namespace TT
@@ -1,6 +1,8 @@
 #pragma once
 #include <bits/stdc++.h>
 
+using Bitboard = std::uint64_t;
+
 enum class Color : std::uint16_t
 {
     BIT_COLOR = 1 << 3,
@@ -29,6 +31,8 @@ enum class Map : std::uint16_t
     CNT_SQUARES = WIDTH * HEIGHT,
     MAX_ATTACKS_PER_SQ = 16,
     MAX_MOVES = 218,
+    MAX_PLY = 128,       // предельная глубина дерева перебора
+    MAX_GAME_PLY = 1024, // предельная длина партии в полуходах
     BIT_SIDE_TO_MOVE = 1,
     BIT_NO_CASTLE_WK = 1 << 1,
     BIT_NO_CASTLE_WQ = 1 << 2,
@@ -3,13 +3,45 @@
 #include "types.h"
 #include "position.hpp"
 #include "movegen.hpp"
+#include "tt.hpp"
+#include "perft.hpp"
+#include "search.hpp"
+#include "memory.hpp"
 
 namespace UCI
 {
 #include "uci_commands.hpp"
     Position g_position;
-    bool quit_flag = false;
-    bool stop_search = true;
+    std::atomic<bool> quit_flag{false};
+
+    // Параметры движка: объявляются в ответ на "uci", меняются через "setoption"
+    struct SpinOption
+    {
+        std::string_view name;
+        int value;
+        int min;
+        int max;
+        void (*on_change)(int value);
+    };
+
+    std::array g_options{
+        // Параметры, которые читает поиск, меняются заданием в его очереди: не под идущим поиском и без ожидания в потоке ввода
+        SpinOption{"Hash", 16, 1, 33554432, [](int mb) { Search::g_thread.post([mb] { TT::g_table.resize(static_cast<size_t>(mb)); }); }},
+        SpinOption{"Threads", 1, 1, 1024, [](int n) { Search::g_thread.post([n] { Search::g_thread.set_threads(static_cast<size_t>(n)); }); }},
+        // 1 - поиск делает ходы copy-make (позиция в слот следующего уровня), 0 - make/unmake
+        SpinOption{"CopyMake", 0, 0, 1, [](int on)
+                   { Search::g_thread.post([on] { Search::g_thread.set_make_mode(on ? MakeMode::COPY_MAKE : MakeMode::MAKE_UNMAKE); }); }},
+        // Кэш поддеревьев для perft_suite и debug_perft, 0 - считать без кэша
+        SpinOption{"PerftHash", 0, 0, 33554432, [](int mb) { Perft::g_cache.resize(static_cast<size_t>(mb)); }},
+    };
+
+    void init_options()
+    {
+        for (const SpinOption &option : g_options)
+        {
+            option.on_change(option.value);
+        }
+    }
 
     Move parse_uci_move(std::string_view sv)
     {
@@ -65,6 +97,18 @@ namespace UCI
 
         std::println("id name {} {}", EngineName, Version);
         std::println("id author {}", AuthorName);
+        for (const SpinOption &option : g_options)
+        {
+            std::println("option name {} type spin default {} min {} max {}", option.name, option.value, option.min, option.max);
+        }
+        if (NNUE::is_loaded())
+        {
+            std::println("info string NNUE evaluation using {}", NNUE::loaded_file());
+        }
+        else
+        {
+            std::println("info string NNUE network not found, using PSQT evaluation");
+        }
         std::println("uciok");
     };
 
@@ -116,6 +160,10 @@ namespace UCI
             }
             while (ss >> token)
             {
+                if (g_position.states.ply() >= static_cast<size_t>(Map::MAX_GAME_PLY))
+                {
+                    g_position.trim_history();
+                }
                 Move m = parse_uci_move(token);
                 g_position.do_move(m);
             }
@@ -124,23 +172,258 @@ namespace UCI
 
     void handle_go()
     {
-        stop_search = false;
-        std::println("{}", __PRETTY_FUNCTION__);
+        std::string line;
+        std::getline(std::cin, line);
+        std::stringstream ss(line);
+        Search::Limits limits;
+        std::string token;
+        while (ss >> token)
+        {
+            if (token == "depth")
+            {
+                ss >> limits.depth;
+            }
+            else if (token == "nodes")
+            {
+                ss >> limits.nodes;
+            }
+            else if (token == "movetime")
+            {
+                ss >> limits.movetime;
+            }
+            else if (token == "infinite")
+            {
+                limits.infinite = true;
+            }
+            else if (token == "wtime")
+            {
+                ss >> limits.time[static_cast<size_t>(Color::WHITE)];
+            }
+            else if (token == "btime")
+            {
+                ss >> limits.time[static_cast<size_t>(Color::BLACK)];
+            }
+            else if (token == "winc")
+            {
+                ss >> limits.inc[static_cast<size_t>(Color::WHITE)];
+            }
+            else if (token == "binc")
+            {
+                ss >> limits.inc[static_cast<size_t>(Color::BLACK)];
+            }
+            else if (token == "movestogo")
+            {
+                ss >> limits.movestogo;
+            }
+        }
+        // Возвращаемся к чтению команд сразу: bestmove выведет поток поиска
+        Search::g_thread.go(g_position, limits);
     };
 
-    void handle_stop()
-    {
-        stop_search = true;
-        std::println("{}", __PRETTY_FUNCTION__);
-    };
+    void handle_stop() { Search::g_thread.stop(); };
 
     void handle_quit_wrapper()
     {
         handle_stop();
+        Search::g_thread.wait();
         quit_flag = true;
     };
 
-    void handle_ucinewgame() { std::println("{}", __PRETTY_FUNCTION__); };
+    void handle_ucinewgame() { Search::g_thread.clear(); };
+
+    // Позиции для bench: дебют, миттельшпиль, тактика, эндшпили
+    constexpr std::array<std::string_view, 8> BENCH_POSITIONS = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+        "2r3k1/pp3ppp/2n1b3/3pP3/3P4/2PB1N2/P4PPP/R5K1 b - - 2 20",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "8/8/4k3/8/2p5/8/B2P4/4K3 w - - 0 1",
+    };
+
+    // bench [depth]: поиск фиксированной глубины по набору позиций с чистыми таблицами.
+    // Узлы детерминированы при Threads = 1 - по ним и эффективному коэффициенту ветвления сравнивают упорядочивание
+    void handle_bench()
+    {
+        std::string line;
+        std::getline(std::cin, line);
+        int depth = 7;
+        std::stringstream(line) >> depth;
+        depth = std::clamp(depth, 1, static_cast<int>(Map::MAX_PLY) - 1);
+
+        handle_ucinewgame();
+        uint64_t total_nodes = 0;
+        double log_branching = 0.0;
+        const auto start = std::chrono::steady_clock::now();
+        for (std::string_view fen : BENCH_POSITIONS)
+        {
+            Position pos;
+            pos.set_from_fen(fen);
+            Search::Limits limits;
+            limits.depth = depth;
+            Search::g_thread.go(pos, limits);
+            Search::g_thread.wait();
+            total_nodes += Search::g_thread.nodes_searched();
+            log_branching += std::log(static_cast<double>(std::max<uint64_t>(Search::g_thread.nodes_searched(), 1))) / depth;
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        std::println("===========================");
+        std::println("Total time (ms) : {}", elapsed);
+        std::println("Nodes searched  : {}", total_nodes);
+        std::println("Nodes/second    : {}", total_nodes * 1000 / std::max<int64_t>(elapsed, 1));
+        // Среднее геометрическое nodes^(1/depth) по позициям
+        std::println("Effective branching factor: {:.2f}", std::exp(log_branching / BENCH_POSITIONS.size()));
+        const Pawns::Stats pawn_stats = Search::g_thread.pawn_stats();
+        std::println("Pawn hash hits  : {:.1f}%", 100.0 * pawn_stats.hits / std::max<uint64_t>(pawn_stats.probes, 1));
+    }
+
+    void handle_setoption()
+    {
+        std::string line;
+        std::getline(std::cin, line);
+        std::stringstream ss(line);
+
+        std::string token, name, value;
+        ss >> token;
+        if (token != "name")
+        {
+            std::println("info string Error: Expected 'name' after 'setoption'");
+            return;
+        }
+        // Имя может состоять из нескольких слов
+        while (ss >> token && token != "value")
+        {
+            name += (name.empty() ? "" : " ") + token;
+        }
+        ss >> value;
+
+        for (SpinOption &option : g_options)
+        {
+            if (option.name != name)
+            {
+                continue;
+            }
+            int v = 0;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), v);
+            if (result.ec != std::errc() || v < option.min || v > option.max)
+            {
+                std::println("info string Error: Invalid value '{}' for option '{}'", value, name);
+                return;
+            }
+            option.value = v;
+            option.on_change(v);
+            return;
+        }
+        std::println("info string Error: Unknown option '{}'", name);
+    };
+
+    // perft_suite <file> [make|copy]: строки "<fen> ;D1 <nodes> ;D2 <nodes> ...", каждая глубина сверяется с ожидаемой.
+    // При расхождении процесс завершается с ошибкой - так "make perft" ловит поломки генератора.
+    // Режим задаёт способ делать ходы (make/unmake по умолчанию или copy-make), "make perft-compare" сравнивает оба
+    void handle_perft_suite()
+    {
+        std::string args;
+        std::getline(std::cin, args);
+        std::stringstream args_stream(args);
+        std::string path, mode = "make";
+        args_stream >> path >> mode;
+        if (mode != "make" && mode != "copy")
+        {
+            std::println("info string Error: Unknown perft mode '{}'", mode);
+            std::exit(EXIT_FAILURE);
+        }
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::println("info string Error: Cannot open perft suite '{}'", path);
+            std::exit(EXIT_FAILURE);
+        }
+
+        Position pos;
+        auto stack = std::make_unique<MoveGen::MoveStack>();
+        PositionStack<MakeMode::COPY_MAKE> copy_positions;
+        int failed = 0;
+        uint64_t total_nodes = 0;
+        int64_t total_ms = 0;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::stringstream ss(line);
+            std::string fen;
+            std::getline(ss, fen, ';');
+            fen.erase(fen.find_last_not_of(' ') + 1);
+            pos.set_from_fen(fen);
+
+            uint64_t position_nodes = 0;
+            const auto start = std::chrono::steady_clock::now();
+            std::string record;
+            while (std::getline(ss, record, ';'))
+            {
+                int depth = 0;
+                uint64_t expected = 0;
+                if (std::sscanf(record.c_str(), " D%d %" SCNu64, &depth, &expected) != 2)
+                {
+                    std::println("info string Error: Bad perft record '{}'", record);
+                    std::exit(EXIT_FAILURE);
+                }
+                depth = std::clamp(depth, 0, static_cast<int>(Map::MAX_PLY));
+                Perft::Stats stats;
+                uint64_t nodes = 0;
+                if (mode == "copy")
+                {
+                    copy_positions.reset(pos);
+#ifdef DEBUG
+                    const uint64_t allocations_before = Memory::t_allocations;
+#endif
+                    nodes = Perft::perft(copy_positions, depth, stack->data(), stats);
+#ifdef DEBUG
+                    stats.allocations = Memory::t_allocations - allocations_before;
+#endif
+                }
+                else
+                {
+#ifdef DEBUG
+                    const uint64_t allocations_before = Memory::t_allocations;
+#endif
+                    nodes = Perft::perft(pos, depth, stack->data(), stats);
+#ifdef DEBUG
+                    stats.allocations = Memory::t_allocations - allocations_before;
+#endif
+                }
+                position_nodes += nodes;
+                if (nodes != expected)
+                {
+                    std::println("FAIL {}: depth {} expected {} got {}", fen, depth, expected, nodes);
+                    ++failed;
+                }
+#ifdef DEBUG
+                if (stats.allocations != 0)
+                {
+                    std::println("FAIL {}: depth {} made {} heap allocations", fen, depth, stats.allocations);
+                    ++failed;
+                }
+#endif
+            }
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::println("{:<80} {:>12} nodes {:>7} ms {:>12} nps", fen, position_nodes, elapsed, position_nodes * 1000 / std::max<int64_t>(elapsed, 1));
+            total_nodes += position_nodes;
+            total_ms += elapsed;
+        }
+
+        std::println("Total ({}): {} nodes {} ms {} nps", mode, total_nodes, total_ms, total_nodes * 1000 / std::max<int64_t>(total_ms, 1));
+        if (failed != 0)
+        {
+            std::println("info string Error: {} perft mismatches", failed);
+            std::exit(EXIT_FAILURE);
+        }
+    }
 
     void uci_loop()
     {
@@ -158,6 +441,11 @@ namespace UCI
                 std::println("info string Unknown command: {}", token);
             }
         }
+        // Конец ввода - то же, что quit: поиск прерывается и успевает вывести bestmove
+        if (!quit_flag)
+        {
+            handle_quit_wrapper();
+        }
     }
 
 #ifdef DEBUG
@@ -168,57 +456,160 @@ void undo_last_move()
     g_position.undo_move();
 }
 
-uint64_t perft(Position& pos, int depth, std::shared_ptr<MoveGen::AttacksArray> attacks_list) {
-    // static std::string path = "";
-    static std::vector<MoveGen::MoveInfo> move_list;
-    
-    if (depth == 0) {
-        // std::println("{{{}}}", path);
-        return 1;
-    }
-    
-    // std::print("{}", *attacks_list);
-    size_t i_from = move_list.size(); 
-    MoveGen::generate_moves(pos, *attacks_list, move_list);
-    size_t i_to = move_list.size();
-
-    uint64_t nodes = 0;
-    for(size_t i = i_from; i < i_to; ++i) {
-        Move m = move_list[i].move;
-        // size_t prev_path_size = path.size();
-        // path += std::string(FEN::index_to_square(m.source()))
-        //                    + "->"
-        //                    + std::string(FEN::index_to_square(m.dest()));
-        // if(m.type() == MoveType::PROMOTION) {
-        //     path+= FEN::piece_to_fen_char(static_cast<uint16_t>(m.promotion_piece()));
-        // }
-        pos.do_move(m);
-        nodes += perft(pos, depth - 1, move_list[i].attacks_list);
-        // path.resize(prev_path_size);
-        pos.undo_move();
-    }
-    move_list.resize(i_from);
-
-    return nodes;
-}
-
 void handle_perft() {
         // ... парсинг глубины
         int depth;
         std::cin>>depth;
+        depth = std::clamp(depth, 0, static_cast<int>(Map::MAX_PLY));
 
-        auto attacks_list = std::make_shared<MoveGen::AttacksArray>();
+        MoveGen::AttacksArray attacks_list;
         Color cur_color = static_cast<Color>(Position::get_side_to_move(g_position));
-        MoveGen::generate_attacks(g_position, cur_color, *attacks_list);
-        
-        std::println("{}", *attacks_list);
-        uint64_t nodes = perft(g_position, depth, attacks_list);
+        MoveGen::generate_attacks(g_position, cur_color, attacks_list);
+        std::println("{}", attacks_list);
+
+        auto stack = std::make_unique<MoveGen::MoveStack>();
+
+        const uint64_t allocations_before = Memory::t_allocations;
+        Perft::Stats stats;
+        uint64_t nodes = Perft::perft(g_position, depth, stack->data(), stats);
+        const uint64_t allocations = Memory::t_allocations - allocations_before;
+
         std::println("Nodes searched: {}", nodes);
+        if (stats.probes != 0) {
+            std::println("Perft cache: {} probes, {} hits ({:.1f}%)", stats.probes, stats.hits, 100.0 * stats.hits / std::max<uint64_t>(stats.probes, 1));
+        }
+        if (allocations != 0) {
+            std::println("info string Error: perft made {} heap allocations", allocations);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // debug_perft_mt <depth> [threads N] [split D]: параллельный perft с разбивкой по ходам корня
+    void handle_perft_mt()
+    {
+        std::string line;
+        std::getline(std::cin, line);
+        std::stringstream ss(line);
+        int depth = 0;
+        int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        int split = 2;
+        ss >> depth;
+        std::string token;
+        while (ss >> token)
+        {
+            if (token == "threads")
+            {
+                ss >> threads;
+            }
+            else if (token == "split")
+            {
+                ss >> split;
+            }
+            else
+            {
+                std::println("info string Error: Unknown parameter '{}' for 'debug_perft_mt'", token);
+                return;
+            }
+        }
+        depth = std::clamp(depth, 0, static_cast<int>(Map::MAX_PLY));
+        // Каждый поток держит свой стек ходов в куче - те же пределы, что у опции Threads
+        const SpinOption &threads_option = *std::ranges::find(g_options, std::string_view("Threads"), &SpinOption::name);
+        threads = std::clamp(threads, threads_option.min, threads_option.max);
+
+        Perft::Stats stats;
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<Perft::RootMoveCount> divide = Perft::parallel_perft(g_position, depth, threads, split, stats);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t nodes = depth == 0 ? 1 : 0;
+        for (const Perft::RootMoveCount &rm : divide)
+        {
+            std::println("{}: {}", rm.move, rm.nodes);
+            nodes += rm.nodes;
+        }
+        std::println("Nodes searched: {}", nodes);
+        std::println("Time: {} ms, threads: {}, nps: {}", elapsed, threads, nodes * 1000 / std::max<int64_t>(elapsed, 1));
+        if (stats.probes != 0) {
+            std::println("Perft cache: {} probes, {} hits ({:.1f}%)", stats.probes, stats.hits, 100.0 * stats.hits / std::max<uint64_t>(stats.probes, 1));
+        }
+        if (stats.allocations != 0) {
+            std::println("info string Error: perft threads made {} heap allocations", stats.allocations);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // debug_random_net <path>: записывает случайную сеть и загружает её вместо текущей
+    void handle_random_net()
+    {
+        std::string path;
+        std::cin >> path;
+        if (!NNUE::write_random(path, 0x4E4E5545) || !NNUE::load(path))
+        {
+            std::println("info string Error: Cannot write test network '{}'", path);
+            std::exit(EXIT_FAILURE);
+        }
+        g_position.refresh_accumulators();
+        std::println("info string Test network {} loaded", path);
+    }
+
+    template <MakeMode M>
+    void nnue_test(PositionStack<M> &positions, int depth, MoveGen::MoveList *ss, uint64_t &nodes, uint64_t &mismatches)
+    {
+        ++nodes;
+        mismatches += NNUE::verify(positions.current());
+        if (depth == 0)
+        {
+            return;
+        }
+        MoveGen::MoveList &move_list = *ss;
+        move_list.clear();
+        MoveGen::generate_moves(positions.current(), move_list);
+        for (const MoveGen::MoveInfo &mi : move_list)
+        {
+            positions.make(mi.move);
+            nnue_test(positions, depth - 1, ss + 1, nodes, mismatches);
+            positions.unmake();
+        }
+    }
+
+    // debug_nnue_test <depth>: NNUE::verify в каждом узле дерева из текущей позиции, в обоих режимах хода
+    void handle_nnue_test()
+    {
+        int depth;
+        std::cin >> depth;
+        depth = std::clamp(depth, 0, static_cast<int>(Map::MAX_PLY));
+        if (!NNUE::is_loaded())
+        {
+            std::println("info string Error: No network loaded");
+            std::exit(EXIT_FAILURE);
+        }
+
+        auto stack = std::make_unique<MoveGen::MoveStack>();
+        uint64_t nodes = 0, mismatches = 0;
+        PositionStack<MakeMode::MAKE_UNMAKE> make_positions(g_position);
+        nnue_test(make_positions, depth, stack->data(), nodes, mismatches);
+        PositionStack<MakeMode::COPY_MAKE> copy_positions;
+        copy_positions.reset(g_position);
+        nnue_test(copy_positions, depth, stack->data(), nodes, mismatches);
+
+        std::println("NNUE test: {} positions, {} mismatches", nodes, mismatches);
+        if (mismatches != 0)
+        {
+            std::exit(EXIT_FAILURE);
+        }
     }
 #endif
 }
 
 int main(const int argc, const char *argv[])
 {
+    // Построчная буферизация и при выводе в канал: GUI должен получить bestmove сразу, а не при заполнении буфера
+    std::setvbuf(stdout, nullptr, _IOLBF, BUFSIZ);
+    BB::init();
+    Zobrist::init();
+    PSQT::init();
+    // Сеть отображается в память один раз при запуске: путь из первого аргумента или файл по умолчанию
+    NNUE::load(argc > 1 ? std::string_view(argv[1]) : NNUE::DEFAULT_FILE);
+    UCI::init_options();
     UCI::uci_loop();
 }
\ No newline at end of file
@@ -38,21 +38,27 @@ extern void handle_go();
 extern void handle_stop();
 extern void handle_quit_wrapper();
 extern void handle_ucinewgame();
+extern void handle_setoption();
+extern void handle_perft_suite();
+extern void handle_bench();
 extern void handle_print_pos();
 extern void undo_last_move();
 extern void handle_perft();
+extern void handle_perft_mt();
+extern void handle_random_net();
+extern void handle_nnue_test();
 struct UciCommandAction {
     const char* name;
     CommandHandler handler;
 };
 struct UciCommandAction;
 
-#define TOTAL_KEYWORDS 10
+#define TOTAL_KEYWORDS 16
 #define MIN_WORD_LENGTH 2
 #define MAX_WORD_LENGTH 20
 #define MIN_HASH_VALUE 2
-#define MAX_HASH_VALUE 25
-/* maximum key range = 24, duplicates = 0 */
+#define MAX_HASH_VALUE 21
+/* maximum key range = 20, duplicates = 0 */
 
 class Perfect_Hash
 {
@@ -67,32 +73,32 @@ Perfect_Hash::hash (const char *str, size_t len)
 {
   static const unsigned char asso_values[] =
     {
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26,  5, 26, 26, 26,  0, 26, 26, 26, 26,
-       0,  0,  5, 26, 26, 26,  0, 26, 26, 26,
-      26,  0, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
-      26, 26, 26, 26, 26, 26
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22,  1, 22, 22,  0,  0, 22, 22, 22, 22,
+       0,  0,  0, 22, 22, 22,  2, 22, 22, 22,
+      22,  0, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+      22, 22, 22, 22, 22, 22
     };
   return len + asso_values[static_cast<unsigned char>(str[len - 1])];
 }
@@ -109,18 +115,22 @@ Perfect_Hash::in_word_set (const char *str, size_t len)
       {""}, {""},
       {"go", handle_go},
       {"uci", handle_uci},
+      {"stop", handle_stop},
+      {"bench", handle_bench},
       {"quit", handle_quit_wrapper},
-      {""}, {""},
       {"isready", handle_isready},
       {"position", handle_position},
-      {"stop", handle_stop},
+      {"setoption", handle_setoption},
       {""},
-      {"debug_perft", handle_perft},
-      {""}, {""}, {""},
       {"ucinewgame", handle_ucinewgame},
-      {""}, {""}, {""}, {""},
+      {"perft_suite", handle_perft_suite},
+      {"debug_perft", handle_perft},
+      {""}, {""},
+      {"debug_perft_mt", handle_perft_mt},
+      {"debug_nnue_test", handle_nnue_test},
+      {"debug_random_net", handle_random_net},
+      {""},
       {"debug_print_position", handle_print_pos},
-      {""}, {""}, {""}, {""},
       {"debug_undo_last_move", undo_last_move}
     };
 #if (defined __GNUC__ && __GNUC__ + (__GNUC_MINOR__ >= 6) > 4) || (defined __clang__ && __clang_major__ >= 3)
@@ -141,4 +151,3 @@ Perfect_Hash::in_word_set (const char *str, size_t len)
     }
   return static_cast<struct UciCommandAction *> (0);
 }
-